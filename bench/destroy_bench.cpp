@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include <entt/entt.hpp>
+
+#include "ecs.h"
+
+/*
+	destroys the same number of instances from worlds of growing size: spread over the whole world,
+	one at a time and then in one batch, and side by side, one at a time. each way starts from a world
+	of its own, so none runs on what another left in the cache. a destroy does the same work in a
+	world of any size: it touches the instance's rows, the rows swapped into their place, and the
+	chunks and ids of both. side by side, those touches share cache lines and the time per destroy
+	grows little with the world. spread out, each touch misses the cache once the world outgrows it,
+	so the time grows with the world. a batch runs the ref policies of all of its instances first,
+	which is what it is for, and then removes them one at a time like single destroys; with no refs
+	in the world it costs what they do, but for sorting the instances to drop duplicates
+*/
+
+static const std::size_t Destroyed = 5000;
+static const int Runs = 5;
+
+double elapsed_ns(std::chrono::steady_clock::time_point since)
+{
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - since).count();
+}
+
+// a world of `size` instances of a few shapes; the instances in the order they were made
+std::vector<instance_entity> populate(ECS& ecs, std::size_t size)
+{
+	ecs_create_type(ecs, "Position", { { "x", EComponentMember::Float }, { "y", EComponentMember::Float } });
+	ecs_create_type(ecs, "Health", { { "hp", EComponentMember::Int } });
+	ecs_create_type(ecs, "Name", { { "name", EComponentMember::String } });
+	ecs_create_type(ecs, "Dead", {});
+
+	auto position = ecs_get_type_handle(ecs, "Position");
+	auto health = ecs_get_type_handle(ecs, "Health");
+	auto dead = ecs_get_type_handle(ecs, "Dead");
+
+	std::vector<instance_entity> instances;
+	instances.reserve(size);
+	for (std::size_t i = 0; i < size; i++)
+	{
+		auto entity = ecs_create_instance(ecs);
+		ecs_adorn_instance(ecs, entity, position);
+		if (i % 2 == 0)
+			ecs_adorn_instance(ecs, entity, health);
+		if (i % 7 == 0)
+			ecs_adorn_instance(ecs, entity, dead);
+		instances.push_back(entity);
+	}
+
+	return instances;
+}
+
+// the time per destroy of `destroy(ecs, instances)`, in a new world of `size` instances, for the
+// instances `pick` chooses out of it; the fastest of `Runs` worlds, as the others were slowed down
+// by something else
+template<typename P, typename D>
+double time_destroys(std::size_t size, P pick, D destroy)
+{
+	double fastest = 0.0;
+	for (int run = 0; run < Runs; run++)
+	{
+		ECS ecs;
+		auto picked = pick(populate(ecs, size));
+
+		auto start = std::chrono::steady_clock::now();
+		destroy(ecs, picked);
+		auto ns = elapsed_ns(start) / picked.size();
+		fastest = run == 0 ? ns : std::min(fastest, ns);
+	}
+
+	return fastest;
+}
+
+int main(int argc, char* argv[])
+{
+	printf("%10s %18s %18s %18s\n", "instances", "ns per destroy", "ns per batched", "ns side by side");
+
+	// entt's default entity type has room for about a million ids, types included
+	for (std::size_t size : { 10000, 100000, 1000000 })
+	{
+		// spread over the whole world
+		auto spread = [size](const std::vector<instance_entity>& instances) {
+			std::vector<instance_entity> picked;
+			auto stride = size / Destroyed;
+			for (std::size_t i = 0; i < Destroyed; i++)
+			{
+				picked.push_back(instances[i * stride]);
+			}
+			return picked;
+		};
+
+		// made one after the other, from the middle of the world
+		auto adjacent = [size](const std::vector<instance_entity>& instances) {
+			auto first = instances.begin() + (size - Destroyed) / 2;
+			return std::vector<instance_entity>(first, first + Destroyed);
+		};
+
+		auto one_by_one = [](ECS& ecs, const std::vector<instance_entity>& instances) {
+			for (auto entity : instances)
+			{
+				ecs_destroy_instance(ecs, entity);
+			}
+		};
+
+		auto batched = [](ECS& ecs, const std::vector<instance_entity>& instances) {
+			ecs_destroy_instances(ecs, instances);
+		};
+
+		auto single_ns = time_destroys(size, spread, one_by_one);
+		auto batch_ns = time_destroys(size, spread, batched);
+		auto adjacent_ns = time_destroys(size, adjacent, one_by_one);
+		printf("%10zu %18.0f %18.0f %18.0f\n", size, single_ns, batch_ns, adjacent_ns);
+	}
+
+	return 0;
+}
@@ -0,0 +1,90 @@
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <entt/entt.hpp>
+
+#include "ecs.h"
+#include "parse.h"
+
+/*
+	runs the same two loops over a world of instances as a plain foreach and as a parallel foreach
+	on a growing number of threads: one moving every instance by its velocity, which the workers
+	rewrite in place, and one adding up a member with +=, which each task sums apart. both only ever
+	touch the row at hand, so the time per pass should fall with the threads until the cores or the
+	memory bandwidth run out. every run adds up the same deltas, so every sum printed is the same
+*/
+
+static const std::size_t Instances = 500000;
+static const int Passes = 5;
+
+double elapsed_ms(std::chrono::steady_clock::time_point since)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+
+// runs `statement` `Passes` times; the time per pass, or a negative one if it failed
+double time_passes(Context& ctx, const std::shared_ptr<Statement>& statement)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (int pass = 0; pass < Passes; pass++)
+	{
+		statement->execute(ctx);
+		ecs_dispatch_events(*ctx.ecs);
+		if (ctx.has_errors())
+			return -1.0;
+	}
+
+	return elapsed_ms(start) / Passes;
+}
+
+int main(int argc, char* argv[])
+{
+	Context ctx;
+	ctx.interpreted_statements = parse(
+		"define Position(x: int, y: int);"
+		"define Velocity(dx: int, dy: int);"
+		"create " + std::to_string(Instances) + " with Position(x: 0, y: 0), Velocity(dx: 1, dy: 2);");
+	if (!ctx.is_parse_okay())
+	{
+		ctx.die_with_error();
+		return 1;
+	}
+	ctx.execute();
+
+	auto loops = parse(
+		"foreach e with Position(x, y), Velocity(dx, dy) { attach Position(x: x + dx, y: y + dy) to e; }"
+		"foreach e with Velocity(dx, dy) { total += dx; }"
+		"parallel foreach e with Position(x, y), Velocity(dx, dy) { attach Position(x: x + dx, y: y + dy) to e; }"
+		"parallel foreach e with Velocity(dx, dy) { total += dx; }");
+	if (!ctx.is_parse_okay())
+	{
+		ctx.die_with_error();
+		return 1;
+	}
+
+	printf("%d passes over %zu instances\n", Passes, Instances);
+	printf("%10s %16s %16s %14s\n", "threads", "ms per move", "ms per sum", "sum");
+
+	// the plain foreach first, then the parallel one on more and more threads
+	for (std::size_t threads : { 0, 1, 2, 4, 8 })
+	{
+		ctx.parallel_workers = threads;
+		ctx.scope->set_binding("total", std::shared_ptr<Expr>(new IntExpr(0)));
+
+		auto move = time_passes(ctx, loops[threads == 0 ? 0 : 2]);
+		auto sum = time_passes(ctx, loops[threads == 0 ? 1 : 3]);
+		if (move < 0.0 || sum < 0.0)
+		{
+			ctx.die_with_error();
+			return 1;
+		}
+
+		auto total = ctx.scope->get_binding("total")->eval(ctx).data.int_value;
+		auto label = threads == 0 ? std::string("foreach") : std::to_string(threads);
+		printf("%10s %16.2f %16.2f %14d\n", label.c_str(), move, sum, total);
+	}
+
+	return 0;
+}
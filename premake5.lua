@@ -31,3 +31,84 @@ workspace "skoundrel"
 			defines { "NDEBUG" }
 			optimize "On"
 			libdirs { "./glfw/build/src/Release" } -- TODO: change later
+
+	-- destroys instances from worlds of growing size; only destroys spread over the world slow down, by cache misses
+	project "DestroyBench"
+		kind "ConsoleApp"
+		language "C++"
+		cppdialect "C++17"
+		targetdir "bin/%{cfg.buildcfg}"
+
+		externalincludedirs {
+			"$(SolutionDir)entt/single_include/",
+		}
+
+		includedirs {
+			"src/"
+		}
+
+		files {
+			"bench/destroy_bench.cpp"
+		}
+
+		filter "configurations:Debug"
+			defines { "DEBUG" }
+			symbols "On"
+
+		filter "configurations:Release"
+			defines { "NDEBUG" }
+			optimize "On"
+
+	-- moves and sums the instances of a world with foreach and parallel foreach on more and more threads
+	project "ParallelBench"
+		kind "ConsoleApp"
+		language "C++"
+		cppdialect "C++17"
+		targetdir "bin/%{cfg.buildcfg}"
+
+		externalincludedirs {
+			"$(SolutionDir)entt/single_include/",
+		}
+
+		includedirs {
+			"src/"
+		}
+
+		files {
+			"bench/parallel_bench.cpp"
+		}
+
+		filter "configurations:Debug"
+			defines { "DEBUG" }
+			symbols "On"
+
+		filter "configurations:Release"
+			defines { "NDEBUG" }
+			optimize "On"
+
+	-- runs statements on small worlds and checks what they were left with, past errors a script would stop at
+	project "WorldChecks"
+		kind "ConsoleApp"
+		language "C++"
+		cppdialect "C++17"
+		targetdir "bin/%{cfg.buildcfg}"
+
+		externalincludedirs {
+			"$(SolutionDir)entt/single_include/",
+		}
+
+		includedirs {
+			"src/"
+		}
+
+		files {
+			"tests/world_checks.cpp"
+		}
+
+		filter "configurations:Debug"
+			defines { "DEBUG" }
+			symbols "On"
+
+		filter "configurations:Release"
+			defines { "NDEBUG" }
+			optimize "On"
@@ -2,9 +2,26 @@
 
 #include <entt/entt.hpp>
 #include <initializer_list>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <array>
+#include <deque>
+#include <map>
+#include <unordered_set>
+#include <set>
+#include <cmath>
+#include <memory>
+#include <optional>
 #include <vector>
 #include <tuple>
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
 struct EntityRef
 {
 	entt::entity value;
@@ -35,7 +52,6 @@ struct InternedCollection
 	std::size_t index;
 };
 
-using comp_entity = entt::entity;
 using instance_entity = entt::entity;
 using type_entity = entt::entity;
 
@@ -51,10 +67,27 @@ enum class EComponentMember
 	Count
 };
 
+// what destroying an instance does to the ref members pointing at it
+enum class ERefPolicy : std::uint8_t
+{
+	Keep,
+	Nullify,
+	Cascade,
+};
+
+enum class EMemberIndex : std::uint8_t
+{
+	None,
+	Hash,
+	Ordered,
+};
+
 struct ComponentMemberDefinition
 {
 	std::string name;
 	EComponentMember kind;
+	ERefPolicy on_destroy = ERefPolicy::Keep;
+	EMemberIndex index = EMemberIndex::None;
 };
 
 struct ComponentMember
@@ -72,283 +105,2976 @@ struct ComponentMember
 	} data;
 };
 
-struct ComponentType
+std::size_t ecs_member_width(EComponentMember kind)
 {
-	static inline constexpr const std::size_t MaxMembers = 10;
-
-	std::string name;
-	std::vector<ComponentMemberDefinition> members;
-	entt::sparse_set adorned_entities;
-};
+	switch (kind)
+	{
+	case EComponentMember::Bool: return sizeof(Bool);
+	case EComponentMember::EntityRef: return sizeof(EntityRef);
+	case EComponentMember::Int: return sizeof(Int);
+	case EComponentMember::Float: return sizeof(Float);
+	case EComponentMember::String: return sizeof(InternedString);
+	case EComponentMember::Collection: return sizeof(InternedCollection);
+	case EComponentMember::None: case EComponentMember::Count: default: return 0;
+	}
+}
 
-struct Instance
+// one packed, untagged array per member; row N of every column belongs to the same instance.
+// rows live in fixed-size pages that forked worlds share copy-on-write: a page is cloned the first
+// time one world writes to it while another still holds it
+struct ComponentColumn
 {
-	std::unordered_map<type_entity, comp_entity> registered;
-};
+	static inline constexpr const std::size_t PageRows = 1024;
+	using Page = std::vector<std::uint8_t>;
 
-struct Component
-{
-	entt::entity key_id;
-	entt::entity type_id;
-	std::unordered_map<std::string, std::uint8_t> member_index;
-	std::vector<ComponentMember> members;
-};
+	EComponentMember kind;
+	std::size_t stride;
+	std::size_t count = 0;
+	std::vector<std::shared_ptr<Page>> pages;
 
-/* ecs */
+	ComponentColumn(EComponentMember kind)
+		: kind(kind)
+		, stride(ecs_member_width(kind))
+	{}
 
-struct ECS
-{
-	entt::registry registry;
-	entt::sparse_set created_entities;
-	std::unordered_map<std::string, type_entity> types;	
+	std::size_t size() const
+	{
+		return count;
+	}
 
-	ECS() {}
-};
+	// write access; clones the page if it is shared
+	std::uint8_t* at(std::size_t row)
+	{
+		auto& page = pages[row / PageRows];
+		if (page.use_count() > 1)
+		{
+			page = std::make_shared<Page>(*page);
+		}
 
-const entt::entity ecs_get_type_id(ECS& ecs, std::string name)
-{
-	return ecs.types[name];
-}
+		return page->data() + (row % PageRows) * stride;
+	}
 
-const ComponentType& ecs_get_type(ECS& ecs, std::string name)
-{
-	return ecs.registry.get<ComponentType>(ecs.types[name]);
-}
+	const std::uint8_t* at(std::size_t row) const
+	{
+		return pages[row / PageRows]->data() + (row % PageRows) * stride;
+	}
 
-entt::entity ecs_create_type(ECS& ecs, std::string name, std::vector<std::tuple<std::string, EComponentMember>> members)
-{
-	assert(members.size() < ComponentType::MaxMembers);
+	// clones every shared page, so that threads may then write rows of their own without cloning
+	void own_pages()
+	{
+		for (auto& page : pages)
+		{
+			if (page.use_count() > 1)
+			{
+				page = std::make_shared<Page>(*page);
+			}
+		}
+	}
 
-	auto entity = ecs.registry.create();
+	// appends `rows` rows with unspecified contents
+	void grow(std::size_t rows)
+	{
+		auto target = count + rows;
+		for (auto page = count / PageRows; page * PageRows < target; page++)
+		{
+			if (page == pages.size())
+			{
+				pages.push_back(std::make_shared<Page>());
+			}
 
-	auto& type_def = ecs.registry.emplace<ComponentType>(entity);
-	type_def.name = name;
+			auto used = std::min(PageRows, target - page * PageRows) * stride;
+			if (pages[page]->size() < used)
+			{
+				if (pages[page].use_count() > 1)
+				{
+					pages[page] = std::make_shared<Page>(*pages[page]);
+				}
+
+				pages[page]->resize(used);
+			}
+		}
+
+		count = target;
+	}
 
-	for (const auto& mem : members)
+	void push(const ComponentMember& value)
 	{
-		auto& member_name = std::get<0>(mem);
-		auto& member_kind = std::get<1>(mem);
+		grow(1);
+		write(count - 1, value);
+	}
 
-		ComponentMemberDefinition def;
-		def.name = member_name;
-		def.kind = member_kind;
-		type_def.members.push_back(def);
+	void push(const ComponentMember& value, std::size_t rows)
+	{
+		auto first = count;
+		grow(rows);
+		for (auto row = first; row < first + rows; row++)
+		{
+			write(row, value);
+		}
 	}
 
-	ecs.types.insert({ name, entity });
+	// appends rows already in packed form
+	void append(const std::uint8_t* data, std::size_t rows)
+	{
+		auto first = count;
+		grow(rows);
+		for (std::size_t row = first; row < count; )
+		{
+			auto span = std::min(PageRows - row % PageRows, count - row);
+			std::memcpy(at(row), data + (row - first) * stride, span * stride);
+			row += span;
+		}
+	}
 
-	return entity;
-}
+	// hands each run of contiguous rows to `visit(data, rows)` in row order
+	template<typename F>
+	void for_each_span(F visit) const
+	{
+		for (std::size_t row = 0; row < count; row += PageRows)
+		{
+			visit(at(row), std::min(PageRows, count - row));
+		}
+	}
 
-instance_entity ecs_create_instance(ECS& ecs)
-{
-	auto entity = ecs.registry.create();
-	ecs.registry.emplace<Instance>(entity);
-	return entity;
-}
+	void write(std::size_t row, const ComponentMember& value)
+	{
+		assert(value.kind == kind);
+		std::memcpy(at(row), &value.data, stride);
+	}
+
+	ComponentMember read(std::size_t row) const
+	{
+		ComponentMember value{};
+		value.kind = kind;
+		std::memcpy(&value.data, at(row), stride);
+		return value;
+	}
+
+	void swap_remove(std::size_t row)
+	{
+		auto last = count - 1;
+		if (row != last)
+		{
+			std::memcpy(at(row), static_cast<const ComponentColumn*>(this)->at(last), stride);
+		}
+
+		count--;
+		if (count % PageRows == 0)
+		{
+			pages.resize(count / PageRows);
+		}
+	}
+};
 
-void ecs_destroy_instance(ECS& ecs, instance_entity entity)
+// entt's sparse set of instances, kept in pages that forked worlds share copy-on-write like the
+// columns: `sparse` holds the position of an instance by its index, `packed` the instance at a position
+struct InstanceSet
 {
-	for (auto& [e, ct] : ecs.registry.view<ComponentType>().each())
+	static inline constexpr const std::size_t PageSize = 1024;
+	static inline constexpr const std::uint32_t Absent = ~std::uint32_t(0);
+
+	using SparsePage = std::array<std::uint32_t, PageSize>;
+	using PackedPage = std::array<entt::entity, PageSize>;
+
+	std::vector<std::shared_ptr<SparsePage>> sparse;
+	std::vector<std::shared_ptr<PackedPage>> packed;
+	std::size_t count = 0;
+
+	std::size_t size() const
+	{
+		return count;
+	}
+
+	bool contains(entt::entity entity) const
+	{
+		auto index = entt::to_entity(entity);
+		auto page = index / PageSize;
+		if (page >= sparse.size() || !sparse[page])
+			return false;
+
+		auto position = (*sparse[page])[index % PageSize];
+		return position != Absent && position < count && at(position) == entity;
+	}
+
+	// the position of an instance in the set
+	std::size_t index(entt::entity entity) const
+	{
+		assert(contains(entity));
+		auto index = entt::to_entity(entity);
+		return (*sparse[index / PageSize])[index % PageSize];
+	}
+
+	// the instance at a position
+	entt::entity at(std::size_t position) const
+	{
+		return (*packed[position / PageSize])[position % PageSize];
+	}
+
+	void emplace(entt::entity entity)
 	{
-		if (ct.adorned_entities.find(entity) != ct.adorned_entities.end())
+		assert(!contains(entity));
+		if (count / PageSize == packed.size())
 		{
-			ct.adorned_entities.remove(entity);
+			packed.push_back(std::make_shared<PackedPage>());
 		}
+
+		packed_for_write(count) = entity;
+		sparse_for_write(entity) = (std::uint32_t)count;
+		count++;
 	}
 
-	for (auto& [e, c] : ecs.registry.view<Component>().each())
+	template<typename It>
+	void insert(It first, It last)
 	{
-		if (c.key_id == entity)
+		for (; first != last; ++first)
 		{
-			ecs.registry.destroy(e);
+			emplace(*first);
 		}
 	}
 
-	ecs.registry.destroy(entity);
-}
+	// moves the last instance into the hole, as entt does
+	void remove(entt::entity entity)
+	{
+		if (!contains(entity))
+			return;
 
-comp_entity ecs_adorn_instance(ECS& ecs, instance_entity key, std::string type_name)
-{
-	assert(ecs.types.count(type_name) > 0);
+		auto position = index(entity);
+		auto last = at(count - 1);
+		if (last != entity)
+		{
+			packed_for_write(position) = last;
+			sparse_for_write(last) = (std::uint32_t)position;
+		}
 
-	const auto& type = ecs.types[type_name];
+		sparse_for_write(entity) = Absent;
+		count--;
+		if (count % PageSize == 0)
+		{
+			packed.resize(count / PageSize);
+		}
+	}
 
-	auto entity = ecs.registry.create();
+	void reserve(std::size_t rows)
+	{
+		packed.reserve((rows + PageSize - 1) / PageSize);
+	}
 
-	auto& instance = ecs.registry.emplace_or_replace<Component>(entity);
-	instance.key_id = key;
-	instance.type_id = type;
+	// the positions the packed pages have room for
+	std::size_t capacity() const
+	{
+		return packed.size() * PageSize;
+	}
 
-	auto& type_def = ecs.registry.get<ComponentType>(type);
-	if (!type_def.adorned_entities.contains(key))
-		type_def.adorned_entities.emplace(key);
+	// the indices the sparse pages cover
+	std::size_t extent() const
+	{
+		return sparse.size() * PageSize;
+	}
 
-	std::uint8_t index = 0;
-	for (const auto& mem : type_def.members)
+	void clear()
 	{
-		ComponentMember member{};
+		sparse.clear();
+		packed.clear();
+		count = 0;
+	}
+
+	void shrink_to_fit()
+	{
+		sparse.shrink_to_fit();
+		packed.shrink_to_fit();
+	}
 
-		instance.member_index.insert({ mem.name, index++ });
-		member.kind = mem.kind;
-		switch (member.kind)
+	std::uint32_t& sparse_for_write(entt::entity entity)
+	{
+		auto index = entt::to_entity(entity);
+		auto page = index / PageSize;
+		if (page >= sparse.size())
+			sparse.resize(page + 1);
+
+		auto& shared = sparse[page];
+		if (!shared)
 		{
-		case EComponentMember::EntityRef:
-			member.data.e.value = entt::null;
-			break;
-		case EComponentMember::Int:
-			member.data.i.value = 0;
-			break;
-		case EComponentMember::Float:
-			member.data.f.value = 0.0f;
-			break;
-		case EComponentMember::Bool:
-			member.data.b.value = false;
-			break;
-		case EComponentMember::String:
-			member.data.s.index = 0;
-			break;
-		case EComponentMember::Collection:
-			member.data.c.index = 0;
-			break;
+			shared = std::make_shared<SparsePage>();
+			shared->fill(Absent);
+		}
+		else if (shared.use_count() > 1)
+		{
+			shared = std::make_shared<SparsePage>(*shared);
+		}
 
-		case EComponentMember::Count:
-		case EComponentMember::None:
-			assert(member.kind != EComponentMember::Count && member.kind != EComponentMember::None);
-			break;
+		return (*shared)[index % PageSize];
+	}
+
+	entt::entity& packed_for_write(std::size_t position)
+	{
+		auto& shared = packed[position / PageSize];
+		if (shared.use_count() > 1)
+		{
+			shared = std::make_shared<PackedPage>(*shared);
 		}
 
-		instance.members.push_back(member);
+		return (*shared)[position % PageSize];
 	}
+};
 
-	auto& instance_reg = ecs.registry.get<Instance>(key);
-	instance_reg.registered.insert({ type, entity });
+// dense index of a script component type, assigned when the type is defined
+struct TypeHandle
+{
+	static inline constexpr const std::uint32_t Invalid = ~std::uint32_t(0);
 
-	return entity;
-}
+	std::uint32_t index = Invalid;
 
-void ecs_unadorn_instance(ECS& ecs, instance_entity key, std::string type_name)
+	bool is_valid() const
+	{
+		return index != Invalid;
+	}
+
+	bool operator==(const TypeHandle& other) const
+	{
+		return index == other.index;
+	}
+
+	bool operator!=(const TypeHandle& other) const
+	{
+		return index != other.index;
+	}
+};
+
+// one bit per script component type, indexed by type handle
+struct TypeSignature
 {
-	assert(ecs.types.count(type_name) > 0);
+	std::vector<std::uint64_t> words;
 
-	const auto& type = ecs.types[type_name];
+	void set(TypeHandle handle)
+	{
+		auto word = handle.index / 64;
+		if (word >= words.size())
+			words.resize(word + 1, 0);
 
-	auto& type_def = ecs.registry.get<ComponentType>(type);
-	type_def.adorned_entities.remove(key);
+		words[word] |= std::uint64_t(1) << (handle.index % 64);
+	}
 
-	auto& component_reg = ecs.registry.get<Instance>(key);
-	auto& comp = component_reg.registered.find(type);
+	void reset(TypeHandle handle)
+	{
+		auto word = handle.index / 64;
+		if (word < words.size())
+			words[word] &= ~(std::uint64_t(1) << (handle.index % 64));
+	}
 
-	if (comp != component_reg.registered.end())
+	bool test(TypeHandle handle) const
 	{
-		ecs.registry.destroy(comp->second);
-		component_reg.registered.erase(comp->first);
+		auto word = handle.index / 64;
+		return word < words.size() && (words[word] & (std::uint64_t(1) << (handle.index % 64))) != 0;
 	}
-}
 
-Component& ecs_get_component_by_instance(ECS& ecs, instance_entity instance_id, std::string type_name)
-{	
-	auto& instance_reg = ecs.registry.get<Instance>(instance_id);
-	auto type_id = ecs.types.find(type_name);
-	assert(type_id != ecs.types.end());
-	return ecs.registry.get<Component>(instance_reg.registered[type_id->second]);
-}
+	// every bit of `other` is also set here
+	bool contains_all(const TypeSignature& other) const
+	{
+		for (std::size_t i = 0; i < other.words.size(); i++)
+		{
+			auto mine = i < words.size() ? words[i] : 0;
+			if ((other.words[i] & ~mine) != 0)
+				return false;
+		}
 
-ComponentMember& ecs_get_member_in_component(ECS& ecs, Component& comp, std::string member_name)
-{
-	auto member_index = comp.member_index.find(member_name)->second;
-	return comp.members[member_index];
-}
+		return true;
+	}
 
-template<typename V>
-void ecs_set_member_in_component(Component& comp, std::string member_name, V value)
-{}
+	bool intersects(const TypeSignature& other) const
+	{
+		auto count = std::min(words.size(), other.words.size());
+		for (std::size_t i = 0; i < count; i++)
+		{
+			if ((words[i] & other.words[i]) != 0)
+				return true;
+		}
+
+		return false;
+	}
 
-template<>
-void ecs_set_member_in_component(Component& comp, std::string member_name, EntityRef e)
+	bool matches(const TypeSignature& positive, const TypeSignature& negative) const
+	{
+		return contains_all(positive) && !intersects(negative);
+	}
+};
+
+// on x86 the bitmaps are also matched four words at a time with AVX2. the build does not assume
+// it: only the kernels are compiled for it, which msvc allows for intrinsics as they are and gcc
+// and clang with a target attribute, and they are only called where the CPU has it
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define ECS_BITMAP_AVX2
+#if defined(_MSC_VER) && !defined(__clang__)
+#define ECS_TARGET_AVX2
+#else
+#define ECS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// whether the CPU has AVX2, and the OS saves its registers
+bool bitmap_cpu_has_avx2()
 {
-	auto member_index = comp.member_index.find(member_name)->second;
-	assert(comp.members[member_index].kind == EComponentMember::EntityRef);
-	comp.members[member_index].data.e = e;
+#if defined(ECS_BITMAP_AVX2) && defined(_MSC_VER) && !defined(__clang__)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+
+	// OSXSAVE and AVX, then the ymm state enabled in XCR0, then AVX2
+	__cpuid(info, 1);
+	if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#elif defined(ECS_BITMAP_AVX2)
+	return __builtin_cpu_supports("avx2");
+#else
+	return false;
+#endif
 }
 
-template<>
-void ecs_set_member_in_component(Component& comp, std::string member_name, Int i)
+// whether bitmap_and and bitmap_andnot take the AVX2 kernels; asked of the CPU once, and only ever
+// turned off to check the word loops against them
+bool BitmapAvx2 = bitmap_cpu_has_avx2();
+
+#if defined(ECS_BITMAP_AVX2)
+// the four-word part of bitmap_and: the words from the first returned on are left to the caller
+ECS_TARGET_AVX2 std::size_t bitmap_and_avx2(std::uint64_t* out, const std::uint64_t* in, std::size_t count)
 {
-	auto member_index = comp.member_index.find(member_name)->second;
-	assert(comp.members[member_index].kind == EComponentMember::Int);
-	comp.members[member_index].data.i = i;
+	std::size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(out + i));
+		auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_and_si256(a, b));
+	}
+
+	return i;
 }
 
-template<>
-void ecs_set_member_in_component(Component& comp, std::string member_name, InternedString s)
+ECS_TARGET_AVX2 std::size_t bitmap_andnot_avx2(std::uint64_t* out, const std::uint64_t* in, std::size_t count)
 {
-	auto member_index = comp.member_index.find(member_name)->second;
-	assert(comp.members[member_index].kind == EComponentMember::String);
-	comp.members[member_index].data.s = s;
+	std::size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(out + i));
+		auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_andnot_si256(b, a));
+	}
+
+	return i;
 }
+#endif
 
-template<>
-void ecs_set_member_in_component(Component& comp, std::string member_name, InternedCollection c)
+// out[i] &= in[i] and out[i] &= ~in[i] over `count` words, four at a time where BitmapAvx2 is set.
+// a bitmap has a word per 64 archetypes, so the kernels only take over from 256 of them on
+void bitmap_and(std::uint64_t* out, const std::uint64_t* in, std::size_t count)
 {
-	auto member_index = comp.member_index.find(member_name)->second;
-	assert(comp.members[member_index].kind == EComponentMember::Collection);
-	comp.members[member_index].data.c = c;
+	std::size_t i = 0;
+#if defined(ECS_BITMAP_AVX2)
+	if (BitmapAvx2 && count >= 4)
+		i = bitmap_and_avx2(out, in, count);
+#endif
+	for (; i < count; i++)
+	{
+		out[i] &= in[i];
+	}
 }
 
-template<>
-void ecs_set_member_in_component(Component& comp, std::string member_name, Float i)
+void bitmap_andnot(std::uint64_t* out, const std::uint64_t* in, std::size_t count)
 {
-	auto member_index = comp.member_index.find(member_name)->second;
-	assert(comp.members[member_index].kind == EComponentMember::Float);
-	comp.members[member_index].data.f = i;
+	std::size_t i = 0;
+#if defined(ECS_BITMAP_AVX2)
+	if (BitmapAvx2 && count >= 4)
+		i = bitmap_andnot_avx2(out, in, count);
+#endif
+	for (; i < count; i++)
+	{
+		out[i] &= ~in[i];
+	}
 }
 
-template<>
-void ecs_set_member_in_component(Component& comp, std::string member_name, Bool b)
+// the index of the lowest set bit of a non-zero word
+std::size_t bitmap_lowest(std::uint64_t word)
 {
-	auto member_index = comp.member_index.find(member_name)->second;
-	assert(comp.members[member_index].kind == EComponentMember::Bool);
-	comp.members[member_index].data.b = b;
+#if defined(_MSC_VER) && defined(_M_IX86)
+	// 32-bit builds have no 64-bit scan
+	unsigned long bit;
+	if (_BitScanForward(&bit, (unsigned long)word))
+		return bit;
+	_BitScanForward(&bit, (unsigned long)(word >> 32));
+	return bit + 32;
+#elif defined(_MSC_VER)
+	unsigned long bit;
+	_BitScanForward64(&bit, word);
+	return bit;
+#else
+	return (std::size_t)__builtin_ctzll(word);
+#endif
 }
 
-entt::sparse_set ecs_query(ECS& ecs, std::vector<std::string> positive, std::vector<std::string> negative = {})
+// one bit per archetype, by index: the archetypes having a type, or the ones matching a query
+struct ArchetypeBitmap
 {
-	entt::sparse_set result;
-	for (auto type_name : positive)
-	{	
-		auto type_id = ecs.types[type_name];
-		auto& comp_type = ecs.registry.get<ComponentType>(type_id);
+	std::vector<std::uint64_t> words;
 
-		if (result.empty())
-		{
-			result.insert(comp_type.adorned_entities.begin(), comp_type.adorned_entities.end());
-		}
-		else
-		{
-			for (auto entity : result)
-			{
-				if (!comp_type.adorned_entities.contains(entity))
-				{
-					result.remove(entity);
-				}
-			}
-		}
+	void set(std::size_t index)
+	{
+		auto word = index / 64;
+		if (word >= words.size())
+			words.resize(word + 1, 0);
+
+		words[word] |= std::uint64_t(1) << (index % 64);
+	}
+
+	bool test(std::size_t index) const
+	{
+		auto word = index / 64;
+		return word < words.size() && (words[word] & (std::uint64_t(1) << (index % 64))) != 0;
 	}
 
-	for (auto type_name : negative)
+	// calls f(index) for every set bit from `first` on, in increasing order
+	template <typename F>
+	void for_each(std::size_t first, F&& f) const
 	{
-		auto type_id = ecs.types[type_name];
-		auto& comp_type = ecs.registry.get<ComponentType>(type_id);
-		
-		for (auto entity : result)
+		for (auto w = first / 64; w < words.size(); w++)
 		{
-			if (comp_type.adorned_entities.contains(entity))
+			auto word = words[w];
+			if (w == first / 64)
+				word &= ~std::uint64_t(0) << (first % 64);
+
+			for (; word != 0; word &= word - 1)
 			{
-				result.remove(entity);
+				f(w * 64 + bitmap_lowest(word));
 			}
 		}
 	}
+};
 
-	return result;
+// a member resolved once against its type's layout; reading or writing through it is an array index
+struct MemberSlot
+{
+	type_entity type = entt::null;
+	std::uint8_t index = 0;
+	EComponentMember kind = EComponentMember::None;
+
+	bool is_valid() const
+	{
+		return kind != EComponentMember::None;
+	}
+};
+
+struct MemberValue
+{
+	MemberSlot slot;
+	ComponentMember value;
+};
+
+// fixed by the type definition and shared by all of its instances
+struct ComponentLayout
+{
+	std::vector<EComponentMember> kinds;
+	std::unordered_map<std::string, std::uint8_t> member_index;
+
+	// packed row encoding: members untagged at their natural width, back to back in declaration order
+	std::vector<std::uint16_t> offsets;
+	std::size_t packed_size = 0;
+};
+
+/* observers */
+
+struct ECS;
+
+enum class EObserverEvent
+{
+	Attach,
+	Detach,
+	Update,
+	Count
+};
+
+struct ObserverEvent
+{
+	EObserverEvent kind;
+	instance_entity entity;
+	TypeHandle type;
+};
+
+// observers receive every event of their kind for one type since the last dispatch, in order raised
+using Observer = std::function<void(ECS&, const std::vector<ObserverEvent>&)>;
+
+// an observer as ecs_observe registered it, with the id ecs_unobserve takes it back by
+struct ObserverSlot
+{
+	std::size_t id;
+	Observer observer;
+};
+
+/* entity refs */
+
+// one ref member of one instance
+struct RefSource
+{
+	instance_entity source;
+	TypeHandle type;
+	std::uint8_t member;
+
+	bool operator==(const RefSource& other) const
+	{
+		return source == other.source && type == other.type && member == other.member;
+	}
+};
+
+struct RefSourceHash
+{
+	std::size_t operator()(const RefSource& ref) const
+	{
+		auto key = ((std::uint64_t)entt::to_integral(ref.source) << 32) ^ ((std::uint64_t)ref.type.index << 8) ^ ref.member;
+		return std::hash<std::uint64_t>{}(key);
+	}
+};
+
+// for every entity, the ref members currently holding it, in pages of targets by entity index that
+// forked worlds share until one of them changes a page
+struct RefIndex
+{
+	static inline constexpr const std::size_t PageSize = 1024;
+
+	using Referrers = std::unordered_set<RefSource, RefSourceHash>;
+	using Page = std::unordered_map<instance_entity, Referrers>;
+
+	std::vector<std::shared_ptr<Page>> pages;
+	// the entities held by at least one ref
+	std::size_t targets = 0;
+
+	bool empty() const
+	{
+		return targets == 0;
+	}
+
+	// the refs holding `target`; null if there are none
+	const Referrers* find(instance_entity target) const
+	{
+		auto page = entt::to_entity(target) / PageSize;
+		if (page >= pages.size() || !pages[page])
+			return nullptr;
+
+		auto found = pages[page]->find(target);
+		return found != pages[page]->end() ? &found->second : nullptr;
+	}
+
+	Page& page_for_write(instance_entity target)
+	{
+		auto page = entt::to_entity(target) / PageSize;
+		if (page >= pages.size())
+			pages.resize(page + 1);
+
+		auto& shared = pages[page];
+		if (!shared)
+		{
+			shared = std::make_shared<Page>();
+		}
+		else if (shared.use_count() > 1)
+		{
+			shared = std::make_shared<Page>(*shared);
+		}
+
+		return *shared;
+	}
+
+	// forgets every ref holding `target`, as those left to a destroyed target by the keep policy
+	void erase(instance_entity target)
+	{
+		if (!find(target))
+			return;
+
+		page_for_write(target).erase(target);
+		targets--;
+	}
+
+	void retarget(const RefSource& ref, instance_entity before, instance_entity after)
+	{
+		if (before == after)
+			return;
+
+		if (before != entt::null && find(before))
+		{
+			auto& page = page_for_write(before);
+			auto found = page.find(before);
+			found->second.erase(ref);
+			if (found->second.empty())
+			{
+				page.erase(found);
+				targets--;
+			}
+		}
+
+		if (after != entt::null)
+		{
+			auto& referrers = page_for_write(after)[after];
+			if (referrers.empty())
+				targets++;
+
+			referrers.insert(ref);
+		}
+	}
+};
+
+/* member indexes */
+
+// the instances of one type by the value of one of its members: hashed for `where member == value`,
+// or, for int and float members, kept sorted so `where member < value` is a slice
+struct MemberIndex
+{
+	std::uint8_t member;
+	EMemberIndex kind = EMemberIndex::Hash;
+	std::unordered_map<std::uint64_t, std::unordered_set<instance_entity>> entities;
+	std::set<std::pair<double, instance_entity>> ordered;
+
+	// members compare by their packed bytes, except that both float zeroes are the same key
+	static std::uint64_t key_of(const ComponentMember& value)
+	{
+		std::uint64_t key = 0;
+		if (value.kind == EComponentMember::Float && value.data.f.value == 0.0f)
+			return key;
+
+		std::memcpy(&key, &value.data, ecs_member_width(value.kind));
+		return key;
+	}
+
+	// ints and floats both fit a double exactly
+	static double order_of(const ComponentMember& value)
+	{
+		return value.kind == EComponentMember::Int ? (double)value.data.i.value : (double)value.data.f.value;
+	}
+
+	void insert(const ComponentMember& value, instance_entity entity)
+	{
+		if (kind == EMemberIndex::Ordered)
+		{
+			// NaN is never in any range, and would break the ordering if it were kept
+			if (!std::isnan(order_of(value)))
+				ordered.insert({ order_of(value), entity });
+			return;
+		}
+
+		entities[key_of(value)].insert(entity);
+	}
+
+	void erase(const ComponentMember& value, instance_entity entity)
+	{
+		if (kind == EMemberIndex::Ordered)
+		{
+			if (!std::isnan(order_of(value)))
+				ordered.erase({ order_of(value), entity });
+			return;
+		}
+
+		auto found = entities.find(key_of(value));
+		if (found != entities.end())
+		{
+			found->second.erase(entity);
+			if (found->second.empty())
+				entities.erase(found);
+		}
+	}
+};
+
+/* journal */
+
+struct ComponentType;
+
+// receives every mutation made through the ecs_* functions while attached with ecs_set_journal
+struct JournalSink
+{
+	virtual ~JournalSink() = default;
+
+	virtual void record_type(const ComponentType& type_def) = 0;
+	virtual void record_tick(std::uint32_t tick) = 0;
+	virtual void record_create(instance_entity entity) = 0;
+	virtual void record_create_many(const std::vector<instance_entity>& entities, const std::vector<TypeHandle>& types, const std::vector<MemberValue>& values) = 0;
+	virtual void record_destroy(instance_entity entity) = 0;
+	virtual void record_adorn(instance_entity entity, TypeHandle type) = 0;
+	virtual void record_unadorn(instance_entity entity, TypeHandle type) = 0;
+	virtual void record_set(instance_entity entity, TypeHandle type, std::uint8_t member, const ComponentMember& value) = 0;
+};
+
+struct ComponentType
+{
+	static inline constexpr const std::size_t MaxMembers = 10;
+
+	type_entity id;
+	TypeHandle handle;
+	std::string name;
+	std::vector<ComponentMemberDefinition> members;
+	ComponentLayout layout;
+
+	// the packed position of an instance in `adorned_entities` is its row in every column
+	InstanceSet adorned_entities;
+	std::vector<ComponentColumn> columns;
+
+	// the archetypes having this type; queries combine these rather than test every archetype
+	ArchetypeBitmap archetypes;
+
+	// change_ticks[row] is the world tick at which that row was last attached or written;
+	// change_tick mirrors ECS::change_tick so member writes can stamp rows without the world at hand
+	ComponentColumn change_ticks{ EComponentMember::Int };
+	std::uint32_t change_tick = 1;
+
+	// a type without members is only a membership: `adorned_entities` and a bit in the signature of
+	// the archetypes having it, with no change ticks and no rows kept in the archetype chunks
+	bool is_tag() const
+	{
+		return columns.empty();
+	}
+
+	std::size_t row_of(instance_entity key) const
+	{
+		return adorned_entities.index(key);
+	}
+
+	void touch(std::size_t row)
+	{
+		if (is_tag())
+			return;
+
+		std::memcpy(change_ticks.at(row), &change_tick, sizeof(change_tick));
+	}
+
+	// stamps rows appended to the columns since the ticks were last extended
+	void touch_new_rows()
+	{
+		if (is_tag())
+			return;
+
+		auto first = change_ticks.size();
+		change_ticks.grow(adorned_entities.size() - first);
+		for (auto row = first; row < change_ticks.size(); row++)
+		{
+			touch(row);
+		}
+	}
+
+	bool changed_since(std::size_t row, std::uint32_t tick) const
+	{
+		assert(!is_tag());
+
+		std::uint32_t changed;
+		std::memcpy(&changed, change_ticks.at(row), sizeof(changed));
+		return changed > tick;
+	}
+
+	// mirrors ECS::journal, for the same reason as change_tick
+	JournalSink* journal = nullptr;
+
+	// mirrors ECS::refs, likewise
+	RefIndex* refs = nullptr;
+
+	instance_entity ref_at(std::size_t member, std::size_t row) const
+	{
+		return columns[member].read(row).data.e.value;
+	}
+
+	// declared with the type; kept in step by write() and the row bookkeeping below. forked worlds
+	// share each index until one of them changes it
+	std::vector<std::shared_ptr<MemberIndex>> indexes;
+
+	MemberIndex& index_for_write(std::size_t k)
+	{
+		auto& index = indexes[k];
+		if (index.use_count() > 1)
+		{
+			index = std::make_shared<MemberIndex>(*index);
+		}
+
+		return *index;
+	}
+
+	// member writes go through here so refs and indexed members stay indexed
+	void write(instance_entity key, std::size_t row, std::size_t member, const ComponentMember& value)
+	{
+		if (refs && value.kind == EComponentMember::EntityRef)
+		{
+			refs->retarget(RefSource{ key, handle, (std::uint8_t)member }, ref_at(member, row), value.data.e.value);
+		}
+
+		for (std::size_t k = 0; k < indexes.size(); k++)
+		{
+			if (indexes[k]->member == member)
+			{
+				auto& index = index_for_write(k);
+				index.erase(columns[member].read(row), key);
+				index.insert(value, key);
+			}
+		}
+
+		columns[member].write(row, value);
+	}
+
+	// indexes rows [first, size), just appended with their values in place
+	void index_new_rows(std::size_t first)
+	{
+		for (std::size_t member = 0; member < columns.size(); member++)
+		{
+			if (!refs || columns[member].kind != EComponentMember::EntityRef)
+				continue;
+
+			for (auto row = first; row < adorned_entities.size(); row++)
+			{
+				refs->retarget(RefSource{ adorned_entities.at(row), handle, (std::uint8_t)member }, entt::null, ref_at(member, row));
+			}
+		}
+
+		for (std::size_t k = 0; k < indexes.size() && first < adorned_entities.size(); k++)
+		{
+			auto& index = index_for_write(k);
+			for (auto row = first; row < adorned_entities.size(); row++)
+			{
+				index.insert(columns[index.member].read(row), adorned_entities.at(row));
+			}
+		}
+	}
+
+	// drops `row` from refs and indexes before it is removed
+	void unindex_row(instance_entity key, std::size_t row)
+	{
+		for (std::size_t member = 0; member < columns.size(); member++)
+		{
+			if (refs && columns[member].kind == EComponentMember::EntityRef)
+			{
+				refs->retarget(RefSource{ key, handle, (std::uint8_t)member }, ref_at(member, row), entt::null);
+			}
+		}
+
+		for (std::size_t k = 0; k < indexes.size(); k++)
+		{
+			auto& index = index_for_write(k);
+			index.erase(columns[index.member].read(row), key);
+		}
+	}
+
+	// events are only queued for kinds somebody observes
+	std::array<std::vector<ObserverSlot>, (std::size_t)EObserverEvent::Count> observers;
+	std::vector<ObserverEvent> pending_events;
+
+	void notify(EObserverEvent kind, instance_entity key)
+	{
+		if (!observers[(std::size_t)kind].empty())
+			pending_events.push_back(ObserverEvent{ kind, key, handle });
+	}
+};
+
+// the types an instance owns are those of its archetype, whose signature answers for it
+struct Instance
+{
+	std::size_t archetype = 0;
+	std::size_t archetype_row = 0;
+};
+
+// every id handed out, in entt's layout of an index in the low bits and a version in the high ones,
+// with the record of each live instance. a destroyed id goes on a free list and comes back with its
+// version bumped, so a ref still holding the old id never finds the new instance. the pages are shared
+// copy-on-write, so a fork carries on from its parent's versions and free list
+struct EntityRegistry
+{
+	static inline constexpr const std::size_t PageSize = 1024;
+	static inline constexpr const std::uint32_t IndexBits = 20;
+	static inline constexpr const std::uint32_t IndexMask = (std::uint32_t(1) << IndexBits) - 1;
+	static inline constexpr const std::uint32_t VersionMask = (std::uint32_t(1) << (32 - IndexBits)) - 1;
+
+	// the entity of a free slot holds the index of the next free one and the version it comes back with
+	struct Slot
+	{
+		entt::entity entity;
+		Instance instance;
+	};
+	using Page = std::array<Slot, PageSize>;
+
+	std::vector<std::shared_ptr<Page>> pages;
+	std::uint32_t slots = 0;
+	std::uint32_t free = IndexMask;
+	std::size_t alive = 0;
+
+	static entt::entity make(std::uint32_t index, std::uint32_t version)
+	{
+		return entt::entity(index | (version << IndexBits));
+	}
+
+	static std::uint32_t index_of(entt::entity entity)
+	{
+		return entt::to_integral(entity) & IndexMask;
+	}
+
+	static std::uint32_t version_of(entt::entity entity)
+	{
+		return entt::to_integral(entity) >> IndexBits;
+	}
+
+	const Slot& slot(std::uint32_t index) const
+	{
+		return (*pages[index / PageSize])[index % PageSize];
+	}
+
+	Slot& slot_for_write(std::uint32_t index)
+	{
+		auto& page = pages[index / PageSize];
+		if (page.use_count() > 1)
+		{
+			page = std::make_shared<Page>(*page);
+		}
+
+		return (*page)[index % PageSize];
+	}
+
+	bool valid(entt::entity entity) const
+	{
+		auto index = index_of(entity);
+		return index < slots && slot(index).entity == entity;
+	}
+
+	const Instance& get(entt::entity entity) const
+	{
+		assert(valid(entity));
+		return slot(index_of(entity)).instance;
+	}
+
+	Instance& get_for_write(entt::entity entity)
+	{
+		assert(valid(entity));
+		return slot_for_write(index_of(entity)).instance;
+	}
+
+	entt::entity create()
+	{
+		alive++;
+		if (free != IndexMask)
+		{
+			auto index = free;
+			auto& reused = slot_for_write(index);
+			free = index_of(reused.entity);
+			reused.entity = make(index, version_of(reused.entity));
+			reused.instance = Instance{};
+			return reused.entity;
+		}
+
+		assert(slots < IndexMask);
+		if (slots % PageSize == 0)
+		{
+			pages.push_back(std::make_shared<Page>());
+		}
+
+		auto& fresh = slot_for_write(slots);
+		fresh.entity = make(slots++, 0);
+		fresh.instance = Instance{};
+		return fresh.entity;
+	}
+
+	template<typename It>
+	void create(It first, It last)
+	{
+		for (; first != last; ++first)
+		{
+			*first = create();
+		}
+	}
+
+	void destroy(entt::entity entity)
+	{
+		assert(valid(entity));
+		// the highest version is entt's tombstone, never handed out
+		auto version = (version_of(entity) + 1) % VersionMask;
+		auto index = index_of(entity);
+		slot_for_write(index).entity = make(free, version);
+		free = index;
+		alive--;
+	}
+
+	template<typename It>
+	void destroy(It first, It last)
+	{
+		for (; first != last; ++first)
+		{
+			destroy(*first);
+		}
+	}
+};
+
+// a handle to one instance's row in its type's columns; rows move, so it is resolved on every access
+struct Component
+{
+	instance_entity key_id;
+	type_entity type_id;
+	ComponentType* type;
+};
+
+/* archetypes */
+
+struct ArchetypeChunk
+{
+	static inline constexpr const std::size_t Capacity = 128;
+
+	std::size_t count = 0;
+	std::array<instance_entity, Capacity> entities;
+
+	// rows[slot][i] is the row of entities[i] in the columns of the archetype's slot-th stored type
+	std::vector<std::array<std::uint32_t, Capacity>> rows;
+};
+
+// all instances owning exactly the same set of script component types, densely packed into chunks
+struct Archetype
+{
+	static inline constexpr const std::size_t NoSlot = ~std::size_t(0);
+
+	std::vector<type_entity> types;
+	std::vector<ComponentType*> type_defs;
+	TypeSignature signature;
+	// the types with members, in slot order; tags are fully described by `signature`
+	std::vector<ComponentType*> stored;
+	std::vector<std::shared_ptr<ArchetypeChunk>> chunks;
+	std::size_t size = 0;
+
+	std::unordered_map<type_entity, std::size_t> add_edges;
+	std::unordered_map<type_entity, std::size_t> remove_edges;
+
+	// the registered queries matching this archetype, told when it gains its first instance or loses its last
+	std::vector<std::size_t> views;
+
+	// NoSlot for a type the archetype lacks, and for tags, which have no rows
+	std::size_t slot_of(type_entity type) const
+	{
+		for (std::size_t slot = 0; slot < stored.size(); slot++)
+		{
+			if (stored[slot]->id == type)
+				return slot;
+		}
+
+		return NoSlot;
+	}
+
+	// write access; forked worlds share chunks until one of them changes it
+	ArchetypeChunk& chunk_for_write(std::size_t index)
+	{
+		auto& chunk = chunks[index];
+		if (chunk.use_count() > 1)
+		{
+			chunk = std::make_shared<ArchetypeChunk>(*chunk);
+		}
+
+		return *chunk;
+	}
+};
+
+struct ArchetypeQuery
+{
+	std::vector<type_entity> positive;
+	std::vector<type_entity> negative;
+	TypeSignature positive_signature;
+	TypeSignature negative_signature;
+	std::vector<std::size_t> matched;
+	ArchetypeBitmap matched_bitmap;
+	std::size_t archetypes_seen = 0;
+
+	// kept only once the query is registered with the world: the matched archetypes holding any instance
+	std::vector<std::size_t> active;
+};
+
+/* deferred structural changes */
+
+enum class ECommand
+{
+	Create,
+	Attach,
+	Detach,
+	Destroy,
+};
+
+// what the instances of one deferred create start with, shared by the commands of all of them
+struct SpawnShape
+{
+	std::vector<TypeHandle> types;
+	std::vector<MemberValue> values;
+};
+
+struct Command
+{
+	ECommand kind;
+	instance_entity entity;
+	TypeHandle type;
+	std::vector<MemberValue> values;
+	std::size_t sequence;
+	std::shared_ptr<const SpawnShape> shape;
+};
+
+struct CommandBuffer
+{
+	std::vector<Command> commands;
+
+	bool empty() const
+	{
+		return commands.empty();
+	}
+};
+
+/* ecs */
+
+struct ECS
+{
+	// instances and types take their ids from the same registry
+	EntityRegistry registry;
+	entt::sparse_set created_entities;
+	std::unordered_map<std::string, type_entity> types;	
+	std::vector<ComponentType*> type_defs;
+	std::deque<ComponentType> type_storage;
+	std::unordered_map<type_entity, TypeHandle> type_handles;
+
+	// held by a world and every fork of it; while they share it, none of them may define a type, since
+	// statements resolve type handles once and run in whichever of the worlds they are handed
+	std::shared_ptr<const void> lineage = std::make_shared<int>(0);
+
+	std::vector<Archetype> archetypes;
+	std::map<std::vector<type_entity>, std::size_t> archetype_index;
+
+	std::uint32_t change_tick = 1;
+	JournalSink* journal = nullptr;
+
+	RefIndex refs;
+	// instances being destroyed, which ref policies leave alone
+	entt::sparse_set dying;
+
+	// the id the next observer registered with this world gets
+	std::size_t next_observer = 0;
+
+	// queries registered with the world, which keeps them current as archetypes are made, filled and
+	// emptied. each lives on its own, so a registration never moves the ones being iterated, and
+	// forked worlds share it until one of them changes it
+	std::vector<std::shared_ptr<ArchetypeQuery>> views;
+	// the view kept for whoever runs it (a foreach statement, say), per world since
+	// forked worlds go on to create different archetypes
+	std::unordered_map<const void*, std::size_t> cached_queries;
+
+	// the type an incremental ecs_compact picks up from
+	std::size_t compact_cursor = 0;
+
+	ECS() 
+	{
+		// archetype 0 holds instances without any components
+		archetypes.push_back(Archetype{});
+		archetype_index.insert({ {}, 0 });
+	}
+};
+
+ArchetypeQuery& ecs_view_for_write(ECS& ecs, std::size_t view)
+{
+	auto& query = ecs.views[view];
+	if (query.use_count() > 1)
+	{
+		query = std::make_shared<ArchetypeQuery>(*query);
+	}
+
+	return *query;
+}
+
+// name lookups are for tooling and for resolving handles once; hot paths take a TypeHandle
+TypeHandle ecs_get_type_handle(ECS& ecs, const std::string& name)
+{
+	auto found = ecs.types.find(name);
+	if (found == ecs.types.end())
+		return TypeHandle{};
+
+	return ecs.type_handles[found->second];
+}
+
+std::vector<TypeHandle> ecs_get_type_handles(ECS& ecs, const std::vector<std::string>& names)
+{
+	std::vector<TypeHandle> handles;
+	for (auto& name : names)
+	{
+		handles.push_back(ecs_get_type_handle(ecs, name));
+		assert(handles.back().is_valid());
+	}
+
+	return handles;
+}
+
+ComponentType& ecs_get_type(ECS& ecs, TypeHandle handle)
+{
+	assert(handle.index < ecs.type_defs.size());
+	return *ecs.type_defs[handle.index];
+}
+
+ComponentType& ecs_get_type(ECS& ecs, type_entity type)
+{
+	assert(ecs.type_handles.count(type) > 0);
+	return ecs_get_type(ecs, ecs.type_handles.find(type)->second);
+}
+
+entt::entity ecs_get_type_id(ECS& ecs, TypeHandle handle)
+{
+	return ecs_get_type(ecs, handle).id;
+}
+
+entt::entity ecs_get_type_id(ECS& ecs, const std::string& name)
+{
+	return ecs.types[name];
+}
+
+const ComponentType& ecs_get_type(ECS& ecs, const std::string& name)
+{
+	return ecs_get_type(ecs, ecs.types[name]);
+}
+
+// whether another world forked from this one, or this one from another, is still around
+bool ecs_has_forks(const ECS& ecs)
+{
+	return ecs.lineage.use_count() > 1;
+}
+
+entt::entity ecs_create_type(ECS& ecs, std::string name, std::vector<ComponentMemberDefinition> members)
+{
+	assert(members.size() < ComponentType::MaxMembers);
+	assert(!ecs_has_forks(ecs));
+
+	auto entity = ecs.registry.create();
+
+	auto& type_def = ecs.type_storage.emplace_back();
+	type_def.id = entity;
+	type_def.handle = TypeHandle{ (std::uint32_t)ecs.type_defs.size() };
+	type_def.name = name;
+	type_def.change_tick = ecs.change_tick;
+	ecs.type_defs.push_back(&type_def);
+	ecs.type_handles.insert({ entity, type_def.handle });
+
+	for (const auto& def : members)
+	{
+		auto& member_name = def.name;
+		auto& member_kind = def.kind;
+
+		type_def.layout.member_index.insert({ member_name, (std::uint8_t)type_def.members.size() });
+		type_def.layout.kinds.push_back(member_kind);
+		type_def.layout.offsets.push_back((std::uint16_t)type_def.layout.packed_size);
+		type_def.layout.packed_size += ecs_member_width(member_kind);
+		type_def.members.push_back(def);
+		type_def.columns.push_back(ComponentColumn(member_kind));
+
+		if (def.index != EMemberIndex::None)
+		{
+			assert(def.index == EMemberIndex::Hash || member_kind == EComponentMember::Int || member_kind == EComponentMember::Float);
+			type_def.indexes.push_back(std::make_shared<MemberIndex>(MemberIndex{ (std::uint8_t)(type_def.members.size() - 1), def.index, {}, {} }));
+		}
+	}
+
+	ecs.types.insert({ name, entity });
+
+	type_def.refs = &ecs.refs;
+	type_def.journal = ecs.journal;
+	if (ecs.journal)
+		ecs.journal->record_type(type_def);
+
+	return entity;
+}
+
+void ecs_match_archetype(ECS& ecs, std::size_t view, std::size_t archetype_index);
+
+std::size_t ecs_get_archetype(ECS& ecs, std::vector<type_entity> types)
+{
+	std::sort(types.begin(), types.end());
+
+	auto found = ecs.archetype_index.find(types);
+	if (found != ecs.archetype_index.end())
+		return found->second;
+
+	Archetype archetype;
+	archetype.types = types;
+	for (auto type : types)
+	{
+		archetype.type_defs.push_back(&ecs_get_type(ecs, type));
+		archetype.signature.set(archetype.type_defs.back()->handle);
+		if (!archetype.type_defs.back()->is_tag())
+			archetype.stored.push_back(archetype.type_defs.back());
+	}
+
+	auto index = ecs.archetypes.size();
+	for (auto type_def : archetype.type_defs)
+	{
+		type_def->archetypes.set(index);
+	}
+	ecs.archetypes.push_back(std::move(archetype));
+	ecs.archetype_index.insert({ types, index });
+
+	for (std::size_t view = 0; view < ecs.views.size(); view++)
+	{
+		ecs_match_archetype(ecs, view, index);
+	}
+
+	return index;
+}
+
+std::size_t ecs_archetype_with(ECS& ecs, std::size_t from, type_entity type)
+{
+	auto edge = ecs.archetypes[from].add_edges.find(type);
+	if (edge != ecs.archetypes[from].add_edges.end())
+		return edge->second;
+
+	auto types = ecs.archetypes[from].types;
+	types.push_back(type);
+
+	auto to = ecs_get_archetype(ecs, types);
+	ecs.archetypes[from].add_edges.insert({ type, to });
+	return to;
+}
+
+std::size_t ecs_archetype_without(ECS& ecs, std::size_t from, type_entity type)
+{
+	auto edge = ecs.archetypes[from].remove_edges.find(type);
+	if (edge != ecs.archetypes[from].remove_edges.end())
+		return edge->second;
+
+	auto types = ecs.archetypes[from].types;
+	types.erase(std::find(types.begin(), types.end(), type));
+
+	auto to = ecs_get_archetype(ecs, types);
+	ecs.archetypes[from].remove_edges.insert({ type, to });
+	return to;
+}
+
+void ecs_archetype_push(ECS& ecs, std::size_t archetype_index, instance_entity key, Instance& instance)
+{
+	auto& archetype = ecs.archetypes[archetype_index];
+	auto position = archetype.size++;
+	auto chunk_index = position / ArchetypeChunk::Capacity;
+
+	if (position == 0)
+	{
+		for (auto view : archetype.views)
+		{
+			ecs_view_for_write(ecs, view).active.push_back(archetype_index);
+		}
+	}
+
+	if (chunk_index == archetype.chunks.size())
+	{
+		auto chunk = std::make_shared<ArchetypeChunk>();
+		chunk->rows.resize(archetype.stored.size());
+		archetype.chunks.push_back(std::move(chunk));
+	}
+
+	auto& chunk = archetype.chunk_for_write(chunk_index);
+	auto i = position % ArchetypeChunk::Capacity;
+	chunk.entities[i] = key;
+	chunk.count = i + 1;
+
+	for (std::size_t slot = 0; slot < archetype.stored.size(); slot++)
+	{
+		chunk.rows[slot][i] = (std::uint32_t)archetype.stored[slot]->row_of(key);
+	}
+
+	instance.archetype = archetype_index;
+	instance.archetype_row = position;
+}
+
+void ecs_archetype_remove(ECS& ecs, Instance& instance)
+{
+	auto& archetype = ecs.archetypes[instance.archetype];
+	auto position = instance.archetype_row;
+	auto last = --archetype.size;
+
+	auto& chunk = archetype.chunk_for_write(position / ArchetypeChunk::Capacity);
+	auto& last_chunk = archetype.chunk_for_write(last / ArchetypeChunk::Capacity);
+	auto i = position % ArchetypeChunk::Capacity;
+	auto j = last % ArchetypeChunk::Capacity;
+
+	if (position != last)
+	{
+		auto moved = last_chunk.entities[j];
+		chunk.entities[i] = moved;
+		for (std::size_t slot = 0; slot < archetype.stored.size(); slot++)
+		{
+			chunk.rows[slot][i] = last_chunk.rows[slot][j];
+		}
+
+		ecs.registry.get_for_write(moved).archetype_row = position;
+	}
+
+	last_chunk.count = j;
+
+	if (last == 0)
+	{
+		for (auto view : archetype.views)
+		{
+			auto& active = ecs_view_for_write(ecs, view).active;
+			active.erase(std::find(active.begin(), active.end(), instance.archetype));
+		}
+	}
+}
+
+void ecs_archetype_move(ECS& ecs, instance_entity key, std::size_t to)
+{
+	auto& instance = ecs.registry.get_for_write(key);
+	ecs_archetype_remove(ecs, instance);
+	ecs_archetype_push(ecs, to, key, instance);
+}
+
+instance_entity ecs_create_instance(ECS& ecs)
+{
+	auto entity = ecs.registry.create();
+	ecs_archetype_push(ecs, 0, entity, ecs.registry.get_for_write(entity));
+
+	if (ecs.journal)
+		ecs.journal->record_create(entity);
+
+	return entity;
+}
+
+ComponentMember ecs_default_member(EComponentMember kind)
+{
+	ComponentMember member{};
+	member.kind = kind;
+	switch (kind)
+	{
+	case EComponentMember::EntityRef:
+		member.data.e.value = entt::null;
+		break;
+	case EComponentMember::Int:
+		member.data.i.value = 0;
+		break;
+	case EComponentMember::Float:
+		member.data.f.value = 0.0f;
+		break;
+	case EComponentMember::Bool:
+		member.data.b.value = false;
+		break;
+	case EComponentMember::String:
+		member.data.s.index = 0;
+		break;
+	case EComponentMember::Collection:
+		member.data.c.index = 0;
+		break;
+
+	case EComponentMember::Count:
+	case EComponentMember::None:
+		assert(kind != EComponentMember::Count && kind != EComponentMember::None);
+		break;
+	}
+
+	return member;
+}
+
+void ecs_remove_row(ECS& ecs, type_entity type, ComponentType& type_def, instance_entity key)
+{
+	if (type_def.is_tag())
+	{
+		type_def.adorned_entities.remove(key);
+		type_def.notify(EObserverEvent::Detach, key);
+		return;
+	}
+
+	// entt's sparse set swaps the last entity into the hole, so the columns do the same
+	auto row = type_def.row_of(key);
+	type_def.unindex_row(key, row);
+	for (auto& column : type_def.columns)
+	{
+		column.swap_remove(row);
+	}
+	type_def.change_ticks.swap_remove(row);
+	type_def.adorned_entities.remove(key);
+	type_def.notify(EObserverEvent::Detach, key);
+
+	if (row < type_def.adorned_entities.size())
+	{
+		auto moved = type_def.adorned_entities.at(row);
+		auto& instance = ecs.registry.get(moved);
+		auto& archetype = ecs.archetypes[instance.archetype];
+		auto& chunk = archetype.chunk_for_write(instance.archetype_row / ArchetypeChunk::Capacity);
+		chunk.rows[archetype.slot_of(type)][instance.archetype_row % ArchetypeChunk::Capacity] = (std::uint32_t)row;
+	}
+}
+
+void ecs_destroy_instance(ECS& ecs, instance_entity entity, std::vector<instance_entity>* removed = nullptr);
+void ecs_set_member_in_component(Component& comp, MemberSlot slot, const ComponentMember& value);
+
+// every ref member currently holding `target`, ordered by source instance
+std::vector<RefSource> ecs_get_referrers(ECS& ecs, instance_entity target)
+{
+	std::vector<RefSource> sources;
+	auto referrers = ecs.refs.find(target);
+	if (!referrers)
+		return sources;
+
+	sources.assign(referrers->begin(), referrers->end());
+	std::sort(sources.begin(), sources.end(), [](const RefSource& a, const RefSource& b) {
+		return std::tie(a.source, a.type.index, a.member) < std::tie(b.source, b.type.index, b.member);
+	});
+
+	return sources;
+}
+
+// applies the on-destroy policy of every ref member holding `target`. sources the cascade policy
+// reaches are marked dying and appended to `cascade` for the caller to destroy, so a chain of any
+// length takes a loop rather than a recursion. the nulls and destroys are journaled like any
+// other, which is why a replay removes instances without running the policies again
+void ecs_release_refs(ECS& ecs, instance_entity target, std::vector<instance_entity>& cascade)
+{
+	for (auto& ref : ecs_get_referrers(ecs, target))
+	{
+		if (ecs.dying.contains(ref.source) || !ecs.registry.valid(ref.source))
+			continue;
+
+		auto& type_def = ecs_get_type(ecs, ref.type);
+		switch (type_def.members[ref.member].on_destroy)
+		{
+		case ERefPolicy::Nullify:
+		{
+			Component comp{ ref.source, type_def.id, &type_def };
+			ecs_set_member_in_component(comp, MemberSlot{ type_def.id, ref.member, EComponentMember::EntityRef }, ecs_default_member(EComponentMember::EntityRef));
+			break;
+		}
+		case ERefPolicy::Cascade:
+			ecs.dying.emplace(ref.source);
+			cascade.push_back(ref.source);
+			break;
+		case ERefPolicy::Keep:
+			break;
+		}
+	}
+}
+
+// takes an instance out of the world without running the policies of the refs holding it
+void ecs_remove_instance(ECS& ecs, instance_entity entity)
+{
+	if (ecs.journal)
+		ecs.journal->record_destroy(entity);
+
+	auto& instance = ecs.registry.get_for_write(entity);
+	for (auto type_def : ecs.archetypes[instance.archetype].type_defs)
+	{
+		ecs_remove_row(ecs, type_def->id, *type_def, entity);
+	}
+
+	ecs_archetype_remove(ecs, instance);
+	ecs.registry.destroy(entity);
+	ecs.refs.erase(entity);
+}
+
+void ecs_destroy_instances(ECS& ecs, std::vector<instance_entity> entities, std::vector<instance_entity>* removed = nullptr);
+
+// `removed`, if given, is appended every instance the destroy took out, those a cascade reached included
+void ecs_destroy_instance(ECS& ecs, instance_entity entity, std::vector<instance_entity>* removed)
+{
+	if (!ecs.registry.valid(entity))
+		return;
+
+	// only instances somebody refers to have policies to run, and those may cascade into a batch
+	if (ecs.refs.find(entity))
+	{
+		ecs_destroy_instances(ecs, { entity }, removed);
+		return;
+	}
+
+	ecs_remove_instance(ecs, entity);
+	if (removed)
+		removed->push_back(entity);
+}
+
+void ecs_destroy_instances(ECS& ecs, std::vector<instance_entity> entities, std::vector<instance_entity>* removed)
+{
+	std::sort(entities.begin(), entities.end());
+	entities.erase(std::unique(entities.begin(), entities.end()), entities.end());
+	entities.erase(std::remove_if(entities.begin(), entities.end(), [&](auto e) { return !ecs.registry.valid(e); }), entities.end());
+
+	// the policies run before anything is removed; whatever a cascade reaches joins the batch and
+	// has its own refs released in turn
+	if (!ecs.refs.empty())
+	{
+		ecs.dying.insert(entities.begin(), entities.end());
+		for (std::size_t next = 0; next < entities.size(); next++)
+		{
+			ecs_release_refs(ecs, entities[next], entities);
+		}
+		ecs.dying.remove(entities.begin(), entities.end());
+	}
+
+	for (auto entity : entities)
+	{
+		ecs_remove_instance(ecs, entity);
+	}
+
+	if (removed)
+		removed->insert(removed->end(), entities.begin(), entities.end());
+}
+
+Component ecs_adorn_instance(ECS& ecs, instance_entity key, TypeHandle handle)
+{
+	auto& type_def = ecs_get_type(ecs, handle);
+	const auto type = type_def.id;
+	auto& instance_reg = ecs.registry.get(key);
+
+	if (ecs.journal)
+		ecs.journal->record_adorn(key, handle);
+
+	if (ecs.archetypes[instance_reg.archetype].signature.test(handle))
+	{
+		// re-attaching resets the existing row instead of adding a second one
+		auto row = type_def.row_of(key);
+		for (std::size_t member = 0; member < type_def.columns.size(); member++)
+		{
+			type_def.write(key, row, member, ecs_default_member(type_def.columns[member].kind));
+		}
+		type_def.touch(row);
+		type_def.notify(EObserverEvent::Update, key);
+	}
+	else
+	{
+		type_def.adorned_entities.emplace(key);
+		for (auto& column : type_def.columns)
+		{
+			column.push(ecs_default_member(column.kind));
+		}
+		type_def.touch_new_rows();
+		type_def.index_new_rows(type_def.row_of(key));
+
+		ecs_archetype_move(ecs, key, ecs_archetype_with(ecs, instance_reg.archetype, type));
+		type_def.notify(EObserverEvent::Attach, key);
+	}
+
+	return Component{ key, type, &type_def };
+}
+
+void ecs_unadorn_instance(ECS& ecs, instance_entity key, TypeHandle handle)
+{
+	auto& type_def = ecs_get_type(ecs, handle);
+	const auto type = type_def.id;
+	auto& instance_reg = ecs.registry.get(key);
+
+	if (!ecs.archetypes[instance_reg.archetype].signature.test(handle))
+		return;
+
+	if (ecs.journal)
+		ecs.journal->record_unadorn(key, handle);
+
+	ecs_remove_row(ecs, type, type_def, key);
+
+	ecs_archetype_move(ecs, key, ecs_archetype_without(ecs, instance_reg.archetype, type));
+}
+
+Component ecs_adorn_instance(ECS& ecs, instance_entity key, TypeHandle handle, const std::vector<MemberValue>& values)
+{
+	auto comp = ecs_adorn_instance(ecs, key, handle);
+	auto row = comp.type->row_of(key);
+	for (auto& member_value : values)
+	{
+		assert(member_value.slot.type == comp.type_id);
+		comp.type->write(key, row, member_value.slot.index, member_value.value);
+
+		if (ecs.journal)
+			ecs.journal->record_set(key, handle, member_value.slot.index, member_value.value);
+	}
+
+	return comp;
+}
+
+Component ecs_adorn_instance(ECS& ecs, instance_entity key, const std::string& type_name)
+{
+	assert(ecs.types.count(type_name) > 0);
+	return ecs_adorn_instance(ecs, key, ecs_get_type_handle(ecs, type_name));
+}
+
+void ecs_unadorn_instance(ECS& ecs, instance_entity key, const std::string& type_name)
+{
+	assert(ecs.types.count(type_name) > 0);
+	ecs_unadorn_instance(ecs, key, ecs_get_type_handle(ecs, type_name));
+}
+
+bool ecs_has_component(ECS& ecs, instance_entity instance_id, TypeHandle handle)
+{
+	return ecs.registry.valid(instance_id) && ecs.archetypes[ecs.registry.get(instance_id).archetype].signature.test(handle);
+}
+
+Component ecs_get_component_by_instance(ECS& ecs, instance_entity instance_id, TypeHandle handle)
+{
+	auto& type_def = ecs_get_type(ecs, handle);
+	assert(ecs_has_component(ecs, instance_id, handle));
+	return Component{ instance_id, type_def.id, &type_def };
+}
+
+Component ecs_get_component_by_instance(ECS& ecs, instance_entity instance_id, const std::string& type_name)
+{	
+	assert(ecs.types.count(type_name) > 0);
+	return ecs_get_component_by_instance(ecs, instance_id, ecs_get_type_handle(ecs, type_name));
+}
+
+/* prefabs */
+
+// an instance shape resolved once: its types, the archetype they make and the value of every member,
+// so spawning from it only copies rows into the columns. made for one world, it stays valid in its forks
+struct Prefab
+{
+	std::vector<TypeHandle> types;
+	TypeSignature signature;
+	std::size_t archetype = 0;
+
+	// rows[k][member] is the value each spawn starts with in types[k]
+	std::vector<std::vector<ComponentMember>> rows;
+
+	// what the rows were made from, for the journal
+	std::vector<MemberValue> values;
+};
+
+// members start from their defaults, overridden by `values`
+Prefab ecs_make_prefab(ECS& ecs, std::vector<TypeHandle> types, const std::vector<MemberValue>& values = {})
+{
+	std::sort(types.begin(), types.end(), [](auto a, auto b) { return a.index < b.index; });
+	types.erase(std::unique(types.begin(), types.end()), types.end());
+
+	Prefab prefab;
+	prefab.types = types;
+	prefab.values = values;
+
+	std::vector<type_entity> type_ids;
+	for (auto handle : types)
+	{
+		auto& type_def = ecs_get_type(ecs, handle);
+		type_ids.push_back(type_def.id);
+		prefab.signature.set(handle);
+
+		std::vector<ComponentMember> row;
+		for (auto& column : type_def.columns)
+		{
+			row.push_back(ecs_default_member(column.kind));
+		}
+		prefab.rows.push_back(row);
+	}
+
+	for (auto& member_value : values)
+	{
+		for (std::size_t k = 0; k < types.size(); k++)
+		{
+			if (type_ids[k] == member_value.slot.type)
+				prefab.rows[k][member_value.slot.index] = member_value.value;
+		}
+	}
+
+	prefab.archetype = ecs_get_archetype(ecs, type_ids);
+	return prefab;
+}
+
+// ids for instances that are made later, by ecs_spawn_reserved: they are taken from the registry now,
+// so they can be bound and handed around, but belong to no archetype until then
+std::vector<instance_entity> ecs_reserve_instances(ECS& ecs, std::size_t count)
+{
+	std::vector<instance_entity> entities(count);
+	ecs.registry.create(entities.begin(), entities.end());
+	return entities;
+}
+
+// makes the reserved `entities` instances shaped by `prefab`, placed straight into its archetype;
+// `overrides`, which must belong to the prefab's types, replace its values for every one of them
+void ecs_spawn_reserved(ECS& ecs, const Prefab& prefab, const std::vector<instance_entity>& entities, const std::vector<MemberValue>& overrides = {})
+{
+	assert(prefab.archetype < ecs.archetypes.size());
+
+	auto count = entities.size();
+	std::vector<ComponentMember> overridden;
+	for (std::size_t k = 0; k < prefab.types.size(); k++)
+	{
+		auto& type_def = ecs_get_type(ecs, prefab.types[k]);
+		auto first_row = type_def.adorned_entities.size();
+		type_def.adorned_entities.reserve(first_row + count);
+		type_def.adorned_entities.insert(entities.begin(), entities.end());
+
+		// the prefab's own row unless something overrides a member of this type
+		auto row = &prefab.rows[k];
+		for (auto& member_value : overrides)
+		{
+			if (member_value.slot.type != type_def.id)
+				continue;
+
+			if (row != &overridden)
+			{
+				overridden = prefab.rows[k];
+				row = &overridden;
+			}
+			overridden[member_value.slot.index] = member_value.value;
+		}
+
+		for (std::size_t index = 0; index < type_def.columns.size(); index++)
+		{
+			type_def.columns[index].push((*row)[index], count);
+		}
+		type_def.touch_new_rows();
+		type_def.index_new_rows(first_row);
+
+		if (!type_def.observers[(std::size_t)EObserverEvent::Attach].empty())
+		{
+			for (auto entity : entities)
+			{
+				type_def.notify(EObserverEvent::Attach, entity);
+			}
+		}
+	}
+
+	for (auto entity : entities)
+	{
+		ecs_archetype_push(ecs, prefab.archetype, entity, ecs.registry.get_for_write(entity));
+	}
+
+	if (ecs.journal)
+	{
+		auto values = prefab.values;
+		values.insert(values.end(), overrides.begin(), overrides.end());
+		ecs.journal->record_create_many(entities, prefab.types, values);
+	}
+}
+
+// creates `count` instances shaped by `prefab`, as ecs_spawn_reserved does
+std::vector<instance_entity> ecs_spawn(ECS& ecs, const Prefab& prefab, std::size_t count, const std::vector<MemberValue>& overrides = {})
+{
+	auto entities = ecs_reserve_instances(ecs, count);
+	ecs_spawn_reserved(ecs, prefab, entities, overrides);
+	return entities;
+}
+
+// creates `count` instances already adorned with `types`, placed straight into their final archetype;
+// members start from their defaults, overridden by `values` for every new instance
+std::vector<instance_entity> ecs_create_instances(ECS& ecs, std::size_t count, std::vector<TypeHandle> types, const std::vector<MemberValue>& values = {})
+{
+	return ecs_spawn(ecs, ecs_make_prefab(ecs, types, values), count);
+}
+
+MemberSlot ecs_get_member_slot(const ComponentType& type_def, const std::string& member_name)
+{
+	MemberSlot slot;
+	auto found = type_def.layout.member_index.find(member_name);
+	if (found != type_def.layout.member_index.end())
+	{
+		slot.type = type_def.id;
+		slot.index = found->second;
+		slot.kind = type_def.layout.kinds[found->second];
+	}
+
+	return slot;
+}
+
+MemberSlot ecs_get_member_slot(ECS& ecs, type_entity type, const std::string& member_name)
+{
+	return ecs_get_member_slot(ecs_get_type(ecs, type), member_name);
+}
+
+ComponentMember ecs_get_member_in_component(const Component& comp, std::size_t member_index)
+{
+	return comp.type->columns[member_index].read(comp.type->row_of(comp.key_id));
+}
+
+ComponentMember ecs_get_member_in_component(const Component& comp, MemberSlot slot)
+{
+	assert(slot.type == comp.type_id);
+	return ecs_get_member_in_component(comp, slot.index);
+}
+
+ComponentMember ecs_get_member_in_component(ECS&, const Component& comp, std::string member_name)
+{
+	auto slot = ecs_get_member_slot(*comp.type, member_name);
+	assert(slot.is_valid());
+	return ecs_get_member_in_component(comp, slot);
+}
+
+#define ECS_MAKE_MEMBER(_type_, _kind_, _field_) \
+ComponentMember ecs_make_member(_type_ value) \
+{ \
+	ComponentMember member{}; \
+	member.kind = _kind_; \
+	member.data._field_ = value; \
+	return member; \
+}
+
+ECS_MAKE_MEMBER(EntityRef, EComponentMember::EntityRef, e)
+ECS_MAKE_MEMBER(Int, EComponentMember::Int, i)
+ECS_MAKE_MEMBER(InternedString, EComponentMember::String, s)
+ECS_MAKE_MEMBER(InternedCollection, EComponentMember::Collection, c)
+ECS_MAKE_MEMBER(Float, EComponentMember::Float, f)
+ECS_MAKE_MEMBER(Bool, EComponentMember::Bool, b)
+
+void ecs_set_member_in_component(Component& comp, MemberSlot slot, const ComponentMember& value)
+{
+	assert(slot.type == comp.type_id);
+	auto row = comp.type->row_of(comp.key_id);
+	comp.type->write(comp.key_id, row, slot.index, value);
+	comp.type->touch(row);
+	comp.type->notify(EObserverEvent::Update, comp.key_id);
+
+	if (comp.type->journal)
+		comp.type->journal->record_set(comp.key_id, comp.type->handle, slot.index, value);
+}
+
+// whether the rows of a type can be rewritten by several threads at once, each to rows of its own:
+// nothing but the row may change, so there can be no journal, update observers, refs or indexes to
+// keep in step. the shared pages are cloned here, up front, rather than by the threads
+bool ecs_prepare_concurrent_writes(ECS& ecs, TypeHandle handle)
+{
+	auto& type_def = ecs_get_type(ecs, handle);
+	if (ecs.journal || type_def.is_tag() || !type_def.indexes.empty() || !type_def.observers[(std::size_t)EObserverEvent::Update].empty())
+		return false;
+
+	for (auto& column : type_def.columns)
+	{
+		if (column.kind == EComponentMember::EntityRef)
+			return false;
+	}
+
+	for (auto& column : type_def.columns)
+	{
+		column.own_pages();
+	}
+	type_def.change_ticks.own_pages();
+	return true;
+}
+
+// rows as ecs_rewrite_component found them: which instance and type each was, and its members
+// followed by its change tick, so the rewrites can be taken back
+struct RewriteLog
+{
+	std::vector<std::pair<instance_entity, TypeHandle>> rows;
+	std::vector<ComponentMember> members;
+
+	void clear()
+	{
+		rows.clear();
+		members.clear();
+	}
+};
+
+// what ecs_adorn_instance does to an instance that has the type already, for a type made ready by
+// ecs_prepare_concurrent_writes: the row is reset to defaults, `values` written and the row stamped.
+// `log`, if given, keeps the row as it was
+void ecs_rewrite_component(ECS& ecs, instance_entity key, TypeHandle handle, const std::vector<MemberValue>& values, RewriteLog* log = nullptr)
+{
+	auto& type_def = ecs_get_type(ecs, handle);
+	auto row = type_def.row_of(key);
+	if (log)
+	{
+		log->rows.push_back({ key, handle });
+		for (auto& column : type_def.columns)
+		{
+			log->members.push_back(column.read(row));
+		}
+		log->members.push_back(type_def.change_ticks.read(row));
+	}
+
+	for (auto& column : type_def.columns)
+	{
+		column.write(row, ecs_default_member(column.kind));
+	}
+
+	for (auto& member_value : values)
+	{
+		type_def.columns[member_value.slot.index].write(row, member_value.value);
+	}
+	type_def.touch(row);
+}
+
+// puts back the rows of `log`, latest first, and empties it
+void ecs_undo_rewrites(ECS& ecs, RewriteLog& log)
+{
+	auto end = log.members.size();
+	for (auto it = log.rows.rbegin(); it != log.rows.rend(); ++it)
+	{
+		auto& type_def = ecs_get_type(ecs, it->second);
+		auto row = type_def.row_of(it->first);
+		auto first = end - type_def.columns.size() - 1;
+		for (std::size_t k = 0; k < type_def.columns.size(); k++)
+		{
+			type_def.columns[k].write(row, log.members[first + k]);
+		}
+		type_def.change_ticks.write(row, log.members[end - 1]);
+		end = first;
+	}
+
+	log.clear();
+}
+
+template<typename V>
+void ecs_set_member_in_component(Component& comp, MemberSlot slot, V value)
+{
+	ecs_set_member_in_component(comp, slot, ecs_make_member(value));
+}
+
+template<typename V>
+void ecs_set_member_in_component(Component& comp, std::string member_name, V value)
+{
+	auto slot = ecs_get_member_slot(*comp.type, member_name);
+	assert(slot.is_valid());
+	ecs_set_member_in_component(comp, slot, value);
+}
+
+const MemberIndex* ecs_get_member_index(const ComponentType& type_def, std::size_t member)
+{
+	for (auto& index : type_def.indexes)
+	{
+		if (index->member == member)
+			return index.get();
+	}
+
+	return nullptr;
+}
+
+// the instances whose `member` holds `value`, ordered by entity; a scan unless the member is indexed.
+// the search stops once more than `limit` are found, so a caller can give up on a lookup that
+// costs more than walking its archetypes would
+std::vector<instance_entity> ecs_find_instances(ECS& ecs, TypeHandle handle, std::size_t member, const ComponentMember& value, std::size_t limit = ~std::size_t(0))
+{
+	auto& type_def = ecs_get_type(ecs, handle);
+	assert(type_def.columns[member].kind == value.kind);
+
+	std::vector<instance_entity> found;
+	auto key = MemberIndex::key_of(value);
+	auto index = ecs_get_member_index(type_def, member);
+	if (index && index->kind == EMemberIndex::Ordered)
+	{
+		auto order = MemberIndex::order_of(value);
+		for (auto it = index->ordered.lower_bound({ order, instance_entity{ 0 } }); it != index->ordered.end() && it->first == order && found.size() <= limit; ++it)
+		{
+			found.push_back(it->second);
+		}
+	}
+	else if (index)
+	{
+		auto matches = index->entities.find(key);
+		if (matches != index->entities.end())
+		{
+			auto end = matches->second.size() > limit ? std::next(matches->second.begin(), limit + 1) : matches->second.end();
+			found.assign(matches->second.begin(), end);
+		}
+	}
+	else
+	{
+		for (std::size_t row = 0; row < type_def.adorned_entities.size() && found.size() <= limit; row++)
+		{
+			if (MemberIndex::key_of(type_def.columns[member].read(row)) == key)
+				found.push_back(type_def.adorned_entities.at(row));
+		}
+	}
+
+	std::sort(found.begin(), found.end());
+	return found;
+}
+
+// bounds on an int or float member; a missing bound is open
+struct MemberRange
+{
+	std::optional<ComponentMember> lower;
+	bool lower_inclusive = true;
+	std::optional<ComponentMember> upper;
+	bool upper_inclusive = true;
+
+	bool contains(double order) const
+	{
+		if (lower.has_value())
+		{
+			auto bound = MemberIndex::order_of(lower.value());
+			if (lower_inclusive ? order < bound : order <= bound)
+				return false;
+		}
+
+		if (upper.has_value())
+		{
+			auto bound = MemberIndex::order_of(upper.value());
+			if (upper_inclusive ? order > bound : order >= bound)
+				return false;
+		}
+
+		return !std::isnan(order);
+	}
+};
+
+// the instances whose `member` lies in `range`, ordered by that member and then by entity;
+// a slice of the ordered index if the member has one, otherwise a scan. `limit` is as above
+std::vector<instance_entity> ecs_find_instances(ECS& ecs, TypeHandle handle, std::size_t member, const MemberRange& range, std::size_t limit = ~std::size_t(0))
+{
+	auto& type_def = ecs_get_type(ecs, handle);
+	auto kind = type_def.columns[member].kind;
+	assert(kind == EComponentMember::Int || kind == EComponentMember::Float);
+	assert(!range.lower.has_value() || range.lower->kind == kind);
+	assert(!range.upper.has_value() || range.upper->kind == kind);
+
+	std::vector<instance_entity> found;
+	auto index = ecs_get_member_index(type_def, member);
+	if (index && index->kind == EMemberIndex::Ordered)
+	{
+		// null sorts after every live entity, so it is the tightest key after all rows of a value
+		auto it = index->ordered.begin();
+		if (range.lower.has_value())
+		{
+			auto bound = MemberIndex::order_of(range.lower.value());
+			it = range.lower_inclusive
+				? index->ordered.lower_bound({ bound, instance_entity{ 0 } })
+				: index->ordered.upper_bound({ bound, entt::null });
+		}
+
+		for (; it != index->ordered.end() && range.contains(it->first) && found.size() <= limit; ++it)
+		{
+			found.push_back(it->second);
+		}
+	}
+	else
+	{
+		std::vector<std::pair<double, instance_entity>> rows;
+		for (std::size_t row = 0; row < type_def.adorned_entities.size(); row++)
+		{
+			auto order = MemberIndex::order_of(type_def.columns[member].read(row));
+			if (range.contains(order))
+				rows.push_back({ order, type_def.adorned_entities.at(row) });
+		}
+
+		if (rows.size() > limit)
+		{
+			rows.resize(limit + 1);
+		}
+
+		std::sort(rows.begin(), rows.end());
+		for (auto& [order, entity] : rows)
+		{
+			found.push_back(entity);
+		}
+	}
+
+	return found;
+}
+
+// collects every match into a new set; to go over them once, walk a registered query with ecs_iterate
+ArchetypeQuery ecs_make_query(ECS& ecs, const std::vector<TypeHandle>& positive, const std::vector<TypeHandle>& negative = {})
+{
+	ArchetypeQuery query;
+	for (auto handle : positive)
+	{
+		query.positive.push_back(ecs_get_type_id(ecs, handle));
+		query.positive_signature.set(handle);
+	}
+
+	for (auto handle : negative)
+	{
+		query.negative.push_back(ecs_get_type_id(ecs, handle));
+		query.negative_signature.set(handle);
+	}
+
+	return query;
+}
+
+ArchetypeQuery ecs_make_query(ECS& ecs, const std::vector<std::string>& positive, const std::vector<std::string>& negative = {})
+{
+	return ecs_make_query(ecs, ecs_get_type_handles(ecs, positive), ecs_get_type_handles(ecs, negative));
+}
+
+// every archetype matching `query`: the AND of its positive types' bitmaps and the ANDN of its
+// negative ones, so the cost grows with the words of the bitmaps rather than with the archetypes
+void ecs_match_archetypes(ECS& ecs, const ArchetypeQuery& query, ArchetypeBitmap& out)
+{
+	out.words.clear();
+	if (query.positive.empty())
+		return;
+
+	out.words = ecs_get_type(ecs, query.positive[0]).archetypes.words;
+	for (std::size_t k = 1; k < query.positive.size(); k++)
+	{
+		// past the end of a bitmap no archetype has the type
+		auto& words = ecs_get_type(ecs, query.positive[k]).archetypes.words;
+		out.words.resize(std::min(out.words.size(), words.size()));
+		bitmap_and(out.words.data(), words.data(), out.words.size());
+	}
+
+	for (auto type : query.negative)
+	{
+		auto& words = ecs_get_type(ecs, type).archetypes.words;
+		bitmap_andnot(out.words.data(), words.data(), std::min(out.words.size(), words.size()));
+	}
+}
+
+void ecs_refresh_query(ECS& ecs, ArchetypeQuery& query)
+{
+	// archetypes are never removed, so only the ones created since the last refresh are new matches
+	ecs_match_archetypes(ecs, query, query.matched_bitmap);
+	query.matched_bitmap.for_each(query.archetypes_seen, [&](std::size_t archetype_index) {
+		query.matched.push_back(archetype_index);
+	});
+	query.archetypes_seen = ecs.archetypes.size();
+}
+
+// adds an archetype known to match to a registered query
+void ecs_add_view_archetype(ECS& ecs, std::size_t view, std::size_t archetype_index)
+{
+	auto& query = ecs_view_for_write(ecs, view);
+	auto& archetype = ecs.archetypes[archetype_index];
+	query.matched.push_back(archetype_index);
+	query.matched_bitmap.set(archetype_index);
+	archetype.views.push_back(view);
+	if (archetype.size > 0)
+		query.active.push_back(archetype_index);
+}
+
+// tests the next archetype in line against a registered query; archetypes are matched in the order they are made
+void ecs_match_archetype(ECS& ecs, std::size_t view, std::size_t archetype_index)
+{
+	auto& query = ecs_view_for_write(ecs, view);
+	assert(query.archetypes_seen == archetype_index);
+	query.archetypes_seen++;
+
+	auto& archetype = ecs.archetypes[archetype_index];
+	if (query.positive.empty() || !archetype.signature.matches(query.positive_signature, query.negative_signature))
+		return;
+
+	ecs_add_view_archetype(ecs, view, archetype_index);
+}
+
+// hands `query` to the world, which from then on keeps its matched and active archetypes current as
+// instances come and go, so running it costs only the archetypes it actually finds rows in
+std::size_t ecs_register_query(ECS& ecs, ArchetypeQuery query)
+{
+	assert(query.archetypes_seen == 0);
+
+	auto view = ecs.views.size();
+	ecs.views.push_back(std::make_shared<ArchetypeQuery>(std::move(query)));
+
+	ArchetypeBitmap matching;
+	ecs_match_archetypes(ecs, *ecs.views[view], matching);
+	matching.for_each(0, [&](std::size_t archetype_index) {
+		ecs_add_view_archetype(ecs, view, archetype_index);
+	});
+	ecs.views[view]->archetypes_seen = ecs.archetypes.size();
+
+	return view;
+}
+
+// whether an instance is in one of the archetypes a registered query matches
+bool ecs_query_matches(const ECS& ecs, const ArchetypeQuery& query, instance_entity entity)
+{
+	return query.matched_bitmap.test(ecs.registry.get(entity).archetype);
+}
+
+// every instance having all of `positive` and none of `negative`, gathered from the archetypes that match
+entt::sparse_set ecs_query(ECS& ecs, const std::vector<TypeHandle>& positive, const std::vector<TypeHandle>& negative = {})
+{
+	entt::sparse_set result;
+
+	ArchetypeBitmap matching;
+	ecs_match_archetypes(ecs, ecs_make_query(ecs, positive, negative), matching);
+	matching.for_each(0, [&](std::size_t archetype_index) {
+		auto& archetype = ecs.archetypes[archetype_index];
+		for (std::size_t position = 0; position < archetype.size; position++)
+		{
+			result.emplace(archetype.chunks[position / ArchetypeChunk::Capacity]->entities[position % ArchetypeChunk::Capacity]);
+		}
+	});
+
+	return result;
+}
+
+entt::sparse_set ecs_query(ECS& ecs, const std::vector<std::string>& positive, const std::vector<std::string>& negative = {})
+{
+	return ecs_query(ecs, ecs_get_type_handles(ecs, positive), ecs_get_type_handles(ecs, negative));
+}
+
+// the query registered for `owner`, made on first use. it is this world's own copy, so what the
+// world changes in it while the owner walks it is not moved to another one. the owner keeps hold of
+// it for the walk: a fork made meanwhile has the world swap in a fresh copy on its next change, and
+// a reference would be left with the one the fork owns, and dangle once the fork is gone
+std::shared_ptr<ArchetypeQuery> ecs_cached_query(ECS& ecs, const void* owner, const std::vector<TypeHandle>& positive, const std::vector<TypeHandle>& negative)
+{
+	auto found = ecs.cached_queries.find(owner);
+	if (found == ecs.cached_queries.end())
+	{
+		found = ecs.cached_queries.insert({ owner, ecs_register_query(ecs, ecs_make_query(ecs, positive, negative)) }).first;
+	}
+
+	ecs_view_for_write(ecs, found->second);
+	return ecs.views[found->second];
+}
+
+/* query iteration */
+
+// the rows a query matches in one archetype chunk: entities[0, count) of `chunk`, which are rows
+// [first, first + count) of archetype `archetype`. `chunk` is only good until the world next
+// changes; whoever runs script code in between finds it again through `archetype` and `first`
+struct QueryChunk
+{
+	std::size_t archetype = 0;
+	std::size_t first = 0;
+	const ArchetypeChunk* chunk = nullptr;
+	std::size_t count = 0;
+};
+
+// a pull-based walk over the instances a registered query matches, a chunk at a time and straight
+// from the archetypes, so nothing is collected up front and stopping early skips the rest. rows
+// created during the walk are not visited, as long as every other structural change waits for it
+struct QueryIterator
+{
+	const ECS* ecs = nullptr;
+	const ArchetypeQuery* query = nullptr;
+	// the query's active archetypes when the walk began, the one being walked, and its size when the walk reached it
+	std::size_t active = 0;
+	std::size_t position = 0;
+	std::size_t size = 0;
+	std::size_t row = 0;
+};
+
+QueryIterator ecs_iterate(const ECS& ecs, const ArchetypeQuery& query)
+{
+	QueryIterator it;
+	it.ecs = &ecs;
+	it.query = &query;
+	it.active = query.active.size();
+	it.size = it.active > 0 ? ecs.archetypes[query.active[0]].size : 0;
+	return it;
+}
+
+// the next chunk of rows; false once the walk is done
+bool ecs_next(QueryIterator& it, QueryChunk& out)
+{
+	while (it.position < it.active)
+	{
+		if (it.row < it.size)
+		{
+			auto archetype_index = it.query->active[it.position];
+			out.archetype = archetype_index;
+			out.first = it.row;
+			out.chunk = it.ecs->archetypes[archetype_index].chunks[it.row / ArchetypeChunk::Capacity].get();
+			out.count = std::min(it.size - it.row, ArchetypeChunk::Capacity);
+			it.row += out.count;
+			return true;
+		}
+
+		it.position++;
+		it.row = 0;
+		it.size = it.position < it.active ? it.ecs->archetypes[it.query->active[it.position]].size : 0;
+	}
+
+	return false;
+}
+
+// how many instances a registered query matches, from the sizes of its archetypes alone
+std::size_t ecs_query_size(const ECS& ecs, const ArchetypeQuery& query)
+{
+	std::size_t size = 0;
+	for (auto archetype_index : query.active)
+	{
+		size += ecs.archetypes[archetype_index].size;
+	}
+
+	return size;
+}
+
+/* change ticks */
+
+// everything attached or written from now on is stamped with the new tick
+std::uint32_t ecs_advance_tick(ECS& ecs)
+{
+	ecs.change_tick++;
+	for (auto type_def : ecs.type_defs)
+	{
+		type_def->change_tick = ecs.change_tick;
+	}
+
+	if (ecs.journal)
+		ecs.journal->record_tick(ecs.change_tick);
+
+	return ecs.change_tick;
+}
+
+bool ecs_changed_since(ECS& ecs, instance_entity instance_id, TypeHandle handle, std::uint32_t tick)
+{
+	if (!ecs_has_component(ecs, instance_id, handle))
+		return false;
+
+	auto& type_def = ecs_get_type(ecs, handle);
+	return type_def.changed_since(type_def.row_of(instance_id), tick);
+}
+
+/* journal */
+
+// starts (or with nullptr, stops) recording mutations; the sink first hears about every type defined so far
+void ecs_set_journal(ECS& ecs, JournalSink* journal)
+{
+	ecs.journal = journal;
+	for (auto type_def : ecs.type_defs)
+	{
+		type_def->journal = journal;
+		if (journal)
+			journal->record_type(*type_def);
+	}
+}
+
+/* observers */
+
+// returns the id ecs_unobserve takes the observer back by
+std::size_t ecs_observe(ECS& ecs, TypeHandle handle, EObserverEvent kind, Observer observer)
+{
+	auto id = ecs.next_observer++;
+	ecs_get_type(ecs, handle).observers[(std::size_t)kind].push_back(ObserverSlot{ id, observer });
+	return id;
+}
+
+void ecs_unobserve(ECS& ecs, TypeHandle handle, EObserverEvent kind, std::size_t id)
+{
+	auto& observers = ecs_get_type(ecs, handle).observers[(std::size_t)kind];
+	observers.erase(std::remove_if(observers.begin(), observers.end(), [id](const ObserverSlot& slot) { return slot.id == id; }), observers.end());
+}
+
+// hands every queued event to its observers, one batch per type and kind; an entity appears at most
+// once per batch. events raised by the observers themselves wait for the next dispatch
+void ecs_dispatch_events(ECS& ecs)
+{
+	std::vector<std::pair<ComponentType*, std::vector<ObserverEvent>>> queued;
+	for (auto type_def : ecs.type_defs)
+	{
+		if (!type_def->pending_events.empty())
+		{
+			queued.push_back({ type_def, std::move(type_def->pending_events) });
+			type_def->pending_events.clear();
+		}
+	}
+
+	for (auto& [type_def, events] : queued)
+	{
+		for (std::size_t kind = 0; kind < (std::size_t)EObserverEvent::Count; kind++)
+		{
+			std::vector<ObserverEvent> batch;
+			entt::sparse_set seen;
+			for (auto& event : events)
+			{
+				if ((std::size_t)event.kind == kind && !seen.contains(event.entity))
+				{
+					seen.emplace(event.entity);
+					batch.push_back(event);
+				}
+			}
+
+			if (batch.empty())
+				continue;
+
+			for (std::size_t o = 0; o < type_def->observers[kind].size(); o++)
+			{
+				type_def->observers[kind][o].observer(ecs, batch);
+			}
+		}
+	}
+}
+
+/* packed rows */
+
+void ecs_pack_row(const ComponentType& type_def, std::size_t row, std::uint8_t* out)
+{
+	for (std::size_t i = 0; i < type_def.columns.size(); i++)
+	{
+		auto& column = type_def.columns[i];
+		std::memcpy(out + type_def.layout.offsets[i], column.at(row), column.stride);
+	}
+}
+
+void ecs_unpack_row(ComponentType& type_def, std::size_t row, const std::uint8_t* in)
+{
+	auto key = type_def.adorned_entities.at(row);
+	for (std::size_t i = 0; i < type_def.columns.size(); i++)
+	{
+		ComponentMember value{};
+		value.kind = type_def.columns[i].kind;
+		std::memcpy(&value.data, in + type_def.layout.offsets[i], type_def.columns[i].stride);
+		type_def.write(key, row, i, value);
+	}
+	type_def.touch(row);
+}
+
+struct ComponentMemoryReport
+{
+	TypeHandle type;
+	std::size_t rows = 0;
+	// what the same rows cost as a vector of tagged ComponentMembers per instance
+	std::size_t tagged_bytes = 0;
+	std::size_t packed_bytes = 0;
+
+	std::size_t saved_bytes() const
+	{
+		return tagged_bytes - packed_bytes;
+	}
+};
+
+ComponentMemoryReport ecs_memory_report(ECS& ecs, TypeHandle handle)
+{
+	auto& type_def = ecs_get_type(ecs, handle);
+
+	ComponentMemoryReport report;
+	report.type = handle;
+	report.rows = type_def.adorned_entities.size();
+	report.tagged_bytes = report.rows * (sizeof(std::vector<ComponentMember>) + type_def.members.size() * sizeof(ComponentMember));
+	report.packed_bytes = report.rows * type_def.layout.packed_size;
+	return report;
+}
+
+std::vector<ComponentMemoryReport> ecs_memory_report(ECS& ecs)
+{
+	std::vector<ComponentMemoryReport> reports;
+	for (auto type_def : ecs.type_defs)
+	{
+		reports.push_back(ecs_memory_report(ecs, type_def->handle));
+	}
+
+	return reports;
+}
+
+/* compaction */
+
+struct CompactionReport
+{
+	std::size_t types_compacted = 0;
+	std::size_t rows_moved = 0;
+	// what the storages held reserved before and after, whether in use or not
+	std::size_t bytes_before = 0;
+	std::size_t bytes_after = 0;
+	// false if the budget ran out before every type was visited
+	bool done = true;
+
+	std::size_t reclaimed_bytes() const
+	{
+		return bytes_before > bytes_after ? bytes_before - bytes_after : 0;
+	}
+};
+
+std::size_t ecs_reserved_bytes(const ComponentColumn& column)
+{
+	auto bytes = column.pages.capacity() * sizeof(std::shared_ptr<ComponentColumn::Page>);
+	for (auto& page : column.pages)
+	{
+		bytes += page->capacity();
+	}
+
+	return bytes;
+}
+
+std::size_t ecs_reserved_bytes(const InstanceSet& set)
+{
+	auto bytes = set.sparse.capacity() * sizeof(std::shared_ptr<InstanceSet::SparsePage>);
+	bytes += set.packed.capacity() * sizeof(std::shared_ptr<InstanceSet::PackedPage>);
+	bytes += set.packed.size() * sizeof(InstanceSet::PackedPage);
+	for (auto& page : set.sparse)
+	{
+		bytes += page ? sizeof(InstanceSet::SparsePage) : 0;
+	}
+
+	return bytes;
+}
+
+std::size_t ecs_reserved_bytes(const EntityRegistry& registry)
+{
+	return registry.pages.capacity() * sizeof(std::shared_ptr<EntityRegistry::Page>) + registry.pages.size() * sizeof(EntityRegistry::Page);
+}
+
+std::size_t ecs_reserved_bytes(const ComponentType& type_def)
+{
+	auto bytes = ecs_reserved_bytes(type_def.adorned_entities);
+	bytes += ecs_reserved_bytes(type_def.change_ticks);
+	for (auto& column : type_def.columns)
+	{
+		bytes += ecs_reserved_bytes(column);
+	}
+
+	return bytes;
+}
+
+std::size_t ecs_reserved_bytes(const Archetype& archetype)
+{
+	auto chunk_bytes = sizeof(ArchetypeChunk) + archetype.stored.size() * sizeof(std::array<std::uint32_t, ArchetypeChunk::Capacity>);
+	return archetype.chunks.capacity() * sizeof(std::shared_ptr<ArchetypeChunk>) + archetype.chunks.size() * chunk_bytes;
+}
+
+// reorders the rows of `type_def` to follow the archetypes, so walking an archetype reads each of its
+// columns front to back, and rebuilds its storage at the size it needs; returns the rows that moved
+std::size_t ecs_compact_type(ECS& ecs, ComponentType& type_def)
+{
+	std::vector<instance_entity> order;
+	order.reserve(type_def.adorned_entities.size());
+	type_def.archetypes.for_each(0, [&](std::size_t archetype_index) {
+		auto& archetype = ecs.archetypes[archetype_index];
+		for (std::size_t position = 0; position < archetype.size; position++)
+		{
+			order.push_back(archetype.chunks[position / ArchetypeChunk::Capacity]->entities[position % ArchetypeChunk::Capacity]);
+		}
+	});
+	assert(order.size() == type_def.adorned_entities.size());
+
+	std::vector<std::size_t> old_rows(order.size());
+	std::size_t moved = 0;
+	for (std::size_t row = 0; row < order.size(); row++)
+	{
+		old_rows[row] = type_def.row_of(order[row]);
+		moved += old_rows[row] != row;
+	}
+
+	// columns are copied even when nothing moved, so every page ends up holding only live rows
+	auto repack = [&](ComponentColumn& column) {
+		ComponentColumn packed(column.kind);
+		packed.grow(order.size());
+		for (std::size_t row = 0; row < order.size(); row++)
+		{
+			std::memcpy(packed.at(row), static_cast<const ComponentColumn&>(column).at(old_rows[row]), column.stride);
+		}
+		column = std::move(packed);
+	};
+
+	for (auto& column : type_def.columns)
+	{
+		repack(column);
+	}
+
+	if (!type_def.is_tag())
+	{
+		repack(type_def.change_ticks);
+	}
+
+	type_def.adorned_entities.clear();
+	type_def.adorned_entities.shrink_to_fit();
+	type_def.adorned_entities.reserve(order.size());
+	type_def.adorned_entities.insert(order.begin(), order.end());
+
+	if (moved > 0 && !type_def.is_tag())
+	{
+		std::uint32_t row = 0;
+		for (auto& archetype : ecs.archetypes)
+		{
+			auto slot = archetype.slot_of(type_def.id);
+			if (slot == Archetype::NoSlot)
+				continue;
+
+			for (std::size_t position = 0; position < archetype.size; position++)
+			{
+				auto& chunk = archetype.chunk_for_write(position / ArchetypeChunk::Capacity);
+				chunk.rows[slot][position % ArchetypeChunk::Capacity] = row++;
+			}
+		}
+	}
+
+	return moved;
+}
+
+// re-packs the storage of types until `row_budget` rows have been visited, then of the archetypes and
+// the instance registry once every type has been; a later call carries on where this one stopped.
+// a type is never split, so each call makes progress even with a budget smaller than one type
+CompactionReport ecs_compact(ECS& ecs, std::size_t row_budget = ~std::size_t(0))
+{
+	CompactionReport report;
+	std::size_t visited = 0;
+
+	for (; ecs.compact_cursor < ecs.type_defs.size(); ecs.compact_cursor++)
+	{
+		auto& type_def = *ecs.type_defs[ecs.compact_cursor];
+		if (report.types_compacted > 0 && visited + type_def.adorned_entities.size() > row_budget)
+		{
+			report.done = false;
+			return report;
+		}
+
+		report.bytes_before += ecs_reserved_bytes(type_def);
+		report.rows_moved += ecs_compact_type(ecs, type_def);
+		report.bytes_after += ecs_reserved_bytes(type_def);
+		report.types_compacted++;
+		visited += type_def.adorned_entities.size();
+	}
+
+	// chunks emptied by removals stay allocated until here
+	for (auto& archetype : ecs.archetypes)
+	{
+		report.bytes_before += ecs_reserved_bytes(archetype);
+		archetype.chunks.resize((archetype.size + ArchetypeChunk::Capacity - 1) / ArchetypeChunk::Capacity);
+		archetype.chunks.shrink_to_fit();
+		report.bytes_after += ecs_reserved_bytes(archetype);
+	}
+
+	// freed ids keep their slots, for their versions
+	report.bytes_before += ecs_reserved_bytes(ecs.registry);
+	ecs.registry.pages.shrink_to_fit();
+	report.bytes_after += ecs_reserved_bytes(ecs.registry);
+
+	ecs.dying.shrink_to_fit();
+	ecs.compact_cursor = 0;
+	return report;
+}
+
+/* deferred structural changes */
+
+// `entities`, reserved with ecs_reserve_instances, are made with the types and values of `shape`
+void ecs_defer_create(CommandBuffer& buffer, const std::vector<instance_entity>& entities, std::shared_ptr<const SpawnShape> shape)
+{
+	for (auto entity : entities)
+	{
+		buffer.commands.push_back(Command{ ECommand::Create, entity, TypeHandle{}, {}, buffer.commands.size(), shape });
+	}
+}
+
+void ecs_defer_attach(CommandBuffer& buffer, instance_entity entity, TypeHandle type, std::vector<MemberValue> values)
+{
+	buffer.commands.push_back(Command{ ECommand::Attach, entity, type, values, buffer.commands.size(), nullptr });
+}
+
+void ecs_defer_detach(CommandBuffer& buffer, instance_entity entity, TypeHandle type)
+{
+	buffer.commands.push_back(Command{ ECommand::Detach, entity, type, {}, buffer.commands.size(), nullptr });
+}
+
+void ecs_defer_destroy(CommandBuffer& buffer, instance_entity entity)
+{
+	buffer.commands.push_back(Command{ ECommand::Destroy, entity, TypeHandle{}, {}, buffer.commands.size(), nullptr });
+}
+
+// moves commands recorded in another buffer (by a worker of a parallel foreach, say) to the end of
+// `buffer`, in order, as if they had been recorded there
+void ecs_defer_commands(CommandBuffer& buffer, std::vector<Command>::iterator first, std::vector<Command>::iterator last)
+{
+	for (; first != last; ++first)
+	{
+		first->sequence = buffer.commands.size();
+		buffer.commands.push_back(std::move(*first));
+	}
+}
+
+// replays a buffer in one batch: a destroy swallows everything else recorded for its entity, and
+// only the last attach or detach of each (entity, type) pair is applied. creates come first, each
+// create statement's instances made together, so the rest can apply to them; an instance destroyed
+// in the same batch it was created in is never made, and only its id is given back. `removed`, if
+// given, is appended every instance the destroys took out, cascades included
+void ecs_flush_commands(ECS& ecs, CommandBuffer& buffer, std::vector<instance_entity>* removed = nullptr)
+{
+	auto& commands = buffer.commands;
+	if (commands.empty())
+		return;
+
+	std::sort(commands.begin(), commands.end(), [](const Command& a, const Command& b) {
+		return std::tie(a.entity, a.type.index, a.sequence) < std::tie(b.entity, b.type.index, b.sequence);
+	});
+
+	std::vector<instance_entity> destroyed;
+	std::vector<Command*> created;
+	std::vector<Command*> structural;
+
+	for (std::size_t first = 0; first < commands.size();)
+	{
+		auto entity = commands[first].entity;
+		auto last = first;
+		bool destroy = false;
+		Command* create = nullptr;
+		while (last < commands.size() && commands[last].entity == entity)
+		{
+			destroy = destroy || commands[last].kind == ECommand::Destroy;
+			if (commands[last].kind == ECommand::Create)
+				create = &commands[last];
+			last++;
+		}
+
+		if (destroy && create)
+		{
+			ecs.registry.destroy(entity);
+		}
+		else if (destroy)
+		{
+			destroyed.push_back(entity);
+		}
+		else
+		{
+			if (create)
+				created.push_back(create);
+
+			for (auto i = first; i < last; i++)
+			{
+				if (commands[i].kind != ECommand::Create && (i + 1 == last || commands[i + 1].type != commands[i].type))
+					structural.push_back(&commands[i]);
+			}
+		}
+
+		first = last;
+	}
+
+	std::sort(created.begin(), created.end(), [](const Command* a, const Command* b) {
+		return a->sequence < b->sequence;
+	});
+
+	std::vector<instance_entity> spawned;
+	for (std::size_t first = 0; first < created.size();)
+	{
+		auto& shape = *created[first]->shape;
+		spawned.clear();
+		for (; first < created.size() && created[first]->shape.get() == &shape; first++)
+		{
+			spawned.push_back(created[first]->entity);
+		}
+
+		ecs_spawn_reserved(ecs, ecs_make_prefab(ecs, shape.types, shape.values), spawned);
+	}
+
+	ecs_destroy_instances(ecs, destroyed, removed);
+
+	// grouped per type, so each type's columns are touched in one run
+	std::sort(structural.begin(), structural.end(), [](const Command* a, const Command* b) {
+		return std::tie(a->kind, a->type.index, a->entity) < std::tie(b->kind, b->type.index, b->entity);
+	});
+
+	for (auto command : structural)
+	{
+		if (!ecs.registry.valid(command->entity))
+			continue;
+
+		if (command->kind == ECommand::Attach)
+		{
+			ecs_adorn_instance(ecs, command->entity, command->type, command->values);
+		}
+		else
+		{
+			ecs_unadorn_instance(ecs, command->entity, command->type);
+		}
+	}
+
+	commands.clear();
+}
+
+/* forking */
+
+// a child world equal to `parent` at the time of the call, sharing everything copy-on-write: the entity
+// registry with its versions and free list, the adorned sets, member columns, change ticks, archetype
+// chunks, ref pages, member indexes and registered queries are copied as tables of pages, so a fork
+// costs time in proportion to the pages of the world and either world pays only for what it changes
+// afterwards. observers, pending events and the journal stay with the parent. neither world may
+// define types while the other is around
+std::shared_ptr<ECS> ecs_fork(ECS& parent)
+{
+	auto child = std::make_shared<ECS>();
+	auto& ecs = *child;
+
+	for (auto parent_def : parent.type_defs)
+	{
+		auto& type_def = ecs.type_storage.emplace_back(*parent_def);
+		type_def.journal = nullptr;
+		type_def.refs = &ecs.refs;
+		type_def.observers = {};
+		type_def.pending_events.clear();
+
+		ecs.type_defs.push_back(&type_def);
+	}
+	ecs.types = parent.types;
+	ecs.type_handles = parent.type_handles;
+
+	ecs.archetypes = parent.archetypes;
+	for (auto& archetype : ecs.archetypes)
+	{
+		for (auto& type_def : archetype.type_defs)
+		{
+			type_def = ecs.type_defs[type_def->handle.index];
+		}
+
+		for (auto& type_def : archetype.stored)
+		{
+			type_def = ecs.type_defs[type_def->handle.index];
+		}
+	}
+	ecs.archetype_index = parent.archetype_index;
+	ecs.registry = parent.registry;
+	ecs.refs = parent.refs;
+	ecs.views = parent.views;
+	ecs.cached_queries = parent.cached_queries;
+	ecs.change_tick = parent.change_tick;
+	ecs.lineage = parent.lineage;
+
+	return child;
 }
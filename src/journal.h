@@ -0,0 +1,583 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ecs.h"
+#include "parse.h"
+#include "snapshot.h"
+
+/*
+	journal, host byte order: the snapshot header with its own magic, then one record after another,
+	each a one-byte tag followed by its fields. ids are the ones of the recording world; interned
+	strings and collections are written out by value, since the replaying world interns its own.
+
+	records are buffered in memory and written to the file in one go at every tick marker
+*/
+
+static inline constexpr const char JournalMagic[8] = { 'S', 'K', 'N', 'D', 'R', 'L', 'J', 'R' };
+static inline constexpr const std::uint32_t JournalVersion = 3;
+
+enum class EJournalRecord : std::uint8_t
+{
+	Type,
+	Tick,
+	Create,
+	CreateMany,
+	Destroy,
+	Adorn,
+	Unadorn,
+	Set,
+};
+
+struct BinaryJournal : public JournalSink
+{
+	std::FILE* file = nullptr;
+	SnapshotWriter buffer;
+
+	// type ids of the recording world, as handed out to record_type
+	std::unordered_map<type_entity, TypeHandle> handles;
+
+	BinaryJournal() = default;
+	BinaryJournal(const BinaryJournal&) = delete;
+	BinaryJournal& operator=(const BinaryJournal&) = delete;
+
+	~BinaryJournal()
+	{
+		close();
+	}
+
+	// starts a new journal, replacing any file at `path`; a journal only replays onto the world it
+	// was started on, so there is no appending to an old one
+	bool open(const std::string& path)
+	{
+		close();
+
+		file = std::fopen(path.c_str(), "wb");
+		if (!file)
+			return false;
+
+		buffer.put_bytes(JournalMagic, sizeof(JournalMagic));
+		buffer.put(JournalVersion);
+		buffer.put(snapshot_layout_check());
+		flush();
+
+		return true;
+	}
+
+	void flush()
+	{
+		if (file && !buffer.bytes.empty())
+		{
+			std::fwrite(buffer.bytes.data(), 1, buffer.bytes.size(), file);
+			std::fflush(file);
+		}
+
+		buffer.bytes.clear();
+	}
+
+	void close()
+	{
+		if (file)
+		{
+			flush();
+			std::fclose(file);
+			file = nullptr;
+		}
+	}
+
+	void put_record(EJournalRecord record)
+	{
+		buffer.put((std::uint8_t)record);
+	}
+
+	void put_value(const TypedValue& value)
+	{
+		buffer.put((std::uint8_t)value.type);
+		switch (value.type)
+		{
+		case EType::Bool: buffer.put((std::uint8_t)value.data.bool_value); break;
+		case EType::Entity: buffer.put_entity(value.data.entity_value); break;
+		case EType::Int: buffer.put(value.data.int_value); break;
+		case EType::Float: buffer.put(value.data.float_value); break;
+		case EType::String: buffer.put_string(InternedStrings.get_string(value.data.intern_string_index).value_or(std::string{})); break;
+		case EType::Collection: put_collection(value.data.intern_collection_index); break;
+		case EType::Null: default: break;
+		}
+	}
+
+	void put_collection(std::size_t index)
+	{
+		auto& collection = InternedCollections.interned_collection_values[index];
+		buffer.put((std::uint32_t)collection.size());
+		for (auto& element : collection)
+		{
+			put_value(element);
+		}
+	}
+
+	void put_member(const ComponentMember& value)
+	{
+		switch (value.kind)
+		{
+		case EComponentMember::Bool: buffer.put((std::uint8_t)value.data.b.value); break;
+		case EComponentMember::EntityRef: buffer.put_entity(value.data.e.value); break;
+		case EComponentMember::Int: buffer.put(value.data.i.value); break;
+		case EComponentMember::Float: buffer.put(value.data.f.value); break;
+		case EComponentMember::String: buffer.put_string(InternedStrings.get_string(value.data.s.index).value_or(std::string{})); break;
+		case EComponentMember::Collection: put_collection(value.data.c.index); break;
+		default: break;
+		}
+	}
+
+	void record_type(const ComponentType& type_def) override
+	{
+		handles[type_def.id] = type_def.handle;
+		put_record(EJournalRecord::Type);
+		buffer.put(type_def.handle.index);
+		snapshot_write_type(buffer, type_def);
+	}
+
+	void record_tick(std::uint32_t tick) override
+	{
+		put_record(EJournalRecord::Tick);
+		buffer.put(tick);
+		flush();
+	}
+
+	void record_create(instance_entity entity) override
+	{
+		put_record(EJournalRecord::Create);
+		buffer.put_entity(entity);
+	}
+
+	void record_create_many(const std::vector<instance_entity>& entities, const std::vector<TypeHandle>& types, const std::vector<MemberValue>& values) override
+	{
+		put_record(EJournalRecord::CreateMany);
+		buffer.put((std::uint32_t)types.size());
+		for (auto handle : types)
+		{
+			buffer.put(handle.index);
+		}
+
+		buffer.put((std::uint32_t)values.size());
+		for (auto& value : values)
+		{
+			buffer.put(handles[value.slot.type].index);
+			buffer.put(value.slot.index);
+			put_member(value.value);
+		}
+
+		buffer.put((std::uint64_t)entities.size());
+		for (auto entity : entities)
+		{
+			buffer.put_entity(entity);
+		}
+	}
+
+	void record_destroy(instance_entity entity) override
+	{
+		put_record(EJournalRecord::Destroy);
+		buffer.put_entity(entity);
+	}
+
+	void record_adorn(instance_entity entity, TypeHandle type) override
+	{
+		put_record(EJournalRecord::Adorn);
+		buffer.put_entity(entity);
+		buffer.put(type.index);
+	}
+
+	void record_unadorn(instance_entity entity, TypeHandle type) override
+	{
+		put_record(EJournalRecord::Unadorn);
+		buffer.put_entity(entity);
+		buffer.put(type.index);
+	}
+
+	void record_set(instance_entity entity, TypeHandle type, std::uint8_t member, const ComponentMember& value) override
+	{
+		put_record(EJournalRecord::Set);
+		buffer.put_entity(entity);
+		buffer.put(type.index);
+		buffer.put(member);
+		put_member(value);
+	}
+};
+
+/* replay */
+
+// ids of the recording world mapped to the replaying one; seed it from a snapshot's remap to replay on top of it
+struct JournalReplay
+{
+	std::unordered_map<std::uint32_t, instance_entity> entities;
+	std::unordered_map<std::uint32_t, ComponentType*> types;
+	std::uint32_t last_tick = 0;
+
+	JournalReplay() = default;
+
+	JournalReplay(const SnapshotRemap& remap)
+	{
+		for (std::size_t i = 0; i < remap.old_entities.size(); i++)
+		{
+			if (remap.old_entities[i] != SnapshotRemap::NoEntity)
+				entities[remap.old_entities[i]] = remap.new_entities[i];
+		}
+	}
+
+	instance_entity entity(std::uint32_t recorded) const
+	{
+		auto found = entities.find(recorded);
+		return found != entities.end() ? found->second : entt::null;
+	}
+
+	ComponentType* type(std::uint32_t recorded) const
+	{
+		auto found = types.find(recorded);
+		return found != types.end() ? found->second : nullptr;
+	}
+};
+
+bool journal_read_value(JournalReplay& replay, SnapshotReader& in, TypedValue& value, int depth = 0);
+
+bool journal_read_collection(JournalReplay& replay, SnapshotReader& in, std::size_t& index, int depth)
+{
+	auto count = in.get<std::uint32_t>();
+	if (!in.ok || depth > 64)
+		return false;
+
+	index = InternedCollections.create_collection();
+	for (std::uint32_t i = 0; i < count; i++)
+	{
+		TypedValue element{};
+		if (!journal_read_value(replay, in, element, depth + 1))
+			return false;
+
+		InternedCollections.add_collection_value(index, element);
+	}
+
+	return true;
+}
+
+bool journal_read_value(JournalReplay& replay, SnapshotReader& in, TypedValue& value, int depth)
+{
+	value.type = (EType)in.get<std::uint8_t>();
+	switch (value.type)
+	{
+	case EType::Null: break;
+	case EType::Bool: value.data.bool_value = in.get<std::uint8_t>() != 0; break;
+	case EType::Entity: value.data.entity_value = replay.entity(in.get<std::uint32_t>()); break;
+	case EType::Int: value.data.int_value = in.get<int>(); break;
+	case EType::Float: value.data.float_value = in.get<float>(); break;
+	case EType::String: value.data.intern_string_index = InternedStrings.add(in.get_string()); break;
+	case EType::Collection: return journal_read_collection(replay, in, value.data.intern_collection_index, depth);
+	default: return false;
+	}
+
+	return in.ok;
+}
+
+bool journal_read_member(JournalReplay& replay, SnapshotReader& in, EComponentMember kind, ComponentMember& value)
+{
+	value = ecs_default_member(kind);
+	switch (kind)
+	{
+	case EComponentMember::Bool: value.data.b.value = in.get<std::uint8_t>() != 0; break;
+	case EComponentMember::EntityRef: value.data.e.value = replay.entity(in.get<std::uint32_t>()); break;
+	case EComponentMember::Int: value.data.i.value = in.get<int>(); break;
+	case EComponentMember::Float: value.data.f.value = in.get<float>(); break;
+	case EComponentMember::String: value.data.s.index = InternedStrings.add(in.get_string()); break;
+	case EComponentMember::Collection: return journal_read_collection(replay, in, value.data.c.index, 0);
+	default: return false;
+	}
+
+	return in.ok;
+}
+
+// reads the member slot and value of a Set or CreateMany value
+bool journal_read_member_value(JournalReplay& replay, SnapshotReader& in, ComponentType*& type_def, MemberValue& value)
+{
+	type_def = replay.type(in.get<std::uint32_t>());
+	auto member = in.get<std::uint8_t>();
+	if (!in.ok || !type_def || member >= type_def->members.size())
+		return false;
+
+	value.slot = MemberSlot{ type_def->id, member, type_def->layout.kinds[member] };
+	return journal_read_member(replay, in, value.slot.kind, value.value);
+}
+
+// reapplies a journal straight through the ecs_* functions; false on a foreign or malformed journal,
+// or on a record touching an instance the replaying world does not know about
+bool ecs_replay_journal(ECS& ecs, const std::string& path, JournalReplay& replay)
+{
+	MappedFile file;
+	if (!file.open(path))
+		return false;
+
+	SnapshotReader in{ file.data, file.size };
+	auto magic = in.get_bytes(sizeof(JournalMagic));
+	if (!magic || std::memcmp(magic, JournalMagic, sizeof(JournalMagic)) != 0)
+		return false;
+
+	if (in.get<std::uint32_t>() != JournalVersion || in.get<std::uint32_t>() != snapshot_layout_check())
+		return false;
+
+	while (in.ok && in.offset < in.size)
+	{
+		auto record = (EJournalRecord)in.get<std::uint8_t>();
+		switch (record)
+		{
+		case EJournalRecord::Type:
+		{
+			auto recorded = in.get<std::uint32_t>();
+			auto type_def = snapshot_read_type(ecs, in);
+			if (!type_def)
+				return false;
+
+			replay.types[recorded] = type_def;
+			break;
+		}
+
+		case EJournalRecord::Tick:
+			replay.last_tick = in.get<std::uint32_t>();
+			ecs_advance_tick(ecs);
+			break;
+
+		case EJournalRecord::Create:
+		{
+			auto recorded = in.get<std::uint32_t>();
+			replay.entities[recorded] = ecs_create_instance(ecs);
+			break;
+		}
+
+		case EJournalRecord::CreateMany:
+		{
+			std::vector<TypeHandle> types;
+			auto type_count = in.get<std::uint32_t>();
+			for (std::uint32_t t = 0; t < type_count && in.ok; t++)
+			{
+				auto type_def = replay.type(in.get<std::uint32_t>());
+				if (!type_def)
+					return false;
+
+				types.push_back(type_def->handle);
+			}
+
+			std::vector<MemberValue> values;
+			auto value_count = in.get<std::uint32_t>();
+			for (std::uint32_t v = 0; v < value_count && in.ok; v++)
+			{
+				ComponentType* type_def = nullptr;
+				MemberValue value;
+				if (!journal_read_member_value(replay, in, type_def, value))
+					return false;
+
+				values.push_back(value);
+			}
+
+			auto count = (std::size_t)in.get<std::uint64_t>();
+			auto ids = in.get_array(count, sizeof(std::uint32_t));
+			if (!ids)
+				return false;
+
+			auto entities = ecs_create_instances(ecs, count, types, values);
+			for (std::size_t i = 0; i < count; i++)
+			{
+				std::uint32_t recorded;
+				std::memcpy(&recorded, ids + i * sizeof(std::uint32_t), sizeof(recorded));
+				replay.entities[recorded] = entities[i];
+			}
+			break;
+		}
+
+		case EJournalRecord::Destroy:
+		{
+			auto recorded = in.get<std::uint32_t>();
+			auto entity = replay.entity(recorded);
+			if (!ecs.registry.valid(entity))
+				return false;
+
+			// the journal already holds whatever the policies did
+			ecs_remove_instance(ecs, entity);
+			replay.entities.erase(recorded);
+			break;
+		}
+
+		case EJournalRecord::Adorn:
+		case EJournalRecord::Unadorn:
+		{
+			auto entity = replay.entity(in.get<std::uint32_t>());
+			auto type_def = replay.type(in.get<std::uint32_t>());
+			if (!ecs.registry.valid(entity) || !type_def)
+				return false;
+
+			if (record == EJournalRecord::Adorn)
+				ecs_adorn_instance(ecs, entity, type_def->handle);
+			else
+				ecs_unadorn_instance(ecs, entity, type_def->handle);
+			break;
+		}
+
+		case EJournalRecord::Set:
+		{
+			auto entity = replay.entity(in.get<std::uint32_t>());
+			ComponentType* type_def = nullptr;
+			MemberValue value;
+			if (!journal_read_member_value(replay, in, type_def, value))
+				return false;
+
+			if (!ecs_has_component(ecs, entity, type_def->handle))
+				return false;
+
+			Component comp{ entity, type_def->id, type_def };
+			ecs_set_member_in_component(comp, value.slot, value.value);
+			break;
+		}
+
+		default:
+			return false;
+		}
+	}
+
+	return in.ok;
+}
+
+/* check */
+
+// the worlds a replay is checked between, and how the ids of one map to the other
+struct ReplayCheck
+{
+	const ECS& recorded;
+	const ECS& replayed;
+	const JournalReplay& replay;
+};
+
+// a ref kept to an instance destroyed since has nothing to map to, so it only has to be dead in both
+bool journal_entities_match(const ReplayCheck& check, entt::entity recorded, entt::entity replayed)
+{
+	if (!check.recorded.registry.valid(recorded))
+		return !check.replayed.registry.valid(replayed);
+
+	return check.replay.entity((std::uint32_t)entt::to_integral(recorded)) == replayed;
+}
+
+// whether two values agree once the recording world's ids are mapped to the replaying one's;
+// strings and collections are compared by what they hold, as each world interns its own
+bool journal_values_match(const ReplayCheck& check, const TypedValue& recorded, const TypedValue& replayed, int depth = 0)
+{
+	if (recorded.type != replayed.type || depth > 64)
+		return false;
+
+	switch (recorded.type)
+	{
+	case EType::Null: return true;
+	case EType::Bool: return recorded.data.bool_value == replayed.data.bool_value;
+	case EType::Entity: return journal_entities_match(check, recorded.data.entity_value, replayed.data.entity_value);
+	case EType::Int: return recorded.data.int_value == replayed.data.int_value;
+	case EType::Float: return recorded.data.float_value == replayed.data.float_value;
+	case EType::String: return InternedStrings.get_string(recorded.data.intern_string_index) == InternedStrings.get_string(replayed.data.intern_string_index);
+	case EType::Collection:
+	{
+		auto& left = InternedCollections.interned_collection_values[recorded.data.intern_collection_index];
+		auto& right = InternedCollections.interned_collection_values[replayed.data.intern_collection_index];
+		if (left.size() != right.size())
+			return false;
+
+		for (std::size_t i = 0; i < left.size(); i++)
+		{
+			if (!journal_values_match(check, left[i], right[i], depth + 1))
+				return false;
+		}
+
+		return true;
+	}
+	default: return false;
+	}
+}
+
+bool journal_members_match(const ReplayCheck& check, EComponentMember kind, const ComponentMember& recorded, const ComponentMember& replayed)
+{
+	switch (kind)
+	{
+	case EComponentMember::Bool: return recorded.data.b.value == replayed.data.b.value;
+	case EComponentMember::EntityRef: return journal_entities_match(check, recorded.data.e.value, replayed.data.e.value);
+	case EComponentMember::Int: return recorded.data.i.value == replayed.data.i.value;
+	case EComponentMember::Float: return recorded.data.f.value == replayed.data.f.value;
+	case EComponentMember::String: return InternedStrings.get_string(recorded.data.s.index) == InternedStrings.get_string(replayed.data.s.index);
+	case EComponentMember::Collection:
+	{
+		TypedValue left{ EType::Collection, {} }, right{ EType::Collection, {} };
+		left.data.intern_collection_index = recorded.data.c.index;
+		right.data.intern_collection_index = replayed.data.c.index;
+		return journal_values_match(check, left, right);
+	}
+	default: return false;
+	}
+}
+
+// whether `replayed`, rebuilt from a snapshot of `recorded` and the journal recorded since, holds the
+// same instances with the same components and values; false with what first differs otherwise
+bool ecs_replay_matches(const ECS& recorded, ECS& replayed, const JournalReplay& replay, std::string& difference)
+{
+	ReplayCheck check{ recorded, replayed, replay };
+
+	std::size_t recorded_instances = 0, replayed_instances = 0;
+	for (auto& archetype : recorded.archetypes)
+	{
+		recorded_instances += archetype.size;
+	}
+
+	for (auto& archetype : replayed.archetypes)
+	{
+		replayed_instances += archetype.size;
+	}
+
+	if (recorded_instances != replayed_instances)
+	{
+		difference = string_format("%zu instances recorded, %zu replayed", recorded_instances, replayed_instances);
+		return false;
+	}
+
+	for (auto type_def : recorded.type_defs)
+	{
+		auto handle = ecs_get_type_handle(replayed, type_def->name);
+		if (!handle.is_valid())
+		{
+			difference = string_format("type %s was not replayed", type_def->name.c_str());
+			return false;
+		}
+
+		auto& other = ecs_get_type(replayed, handle);
+		if (other.members.size() != type_def->members.size() || other.adorned_entities.size() != type_def->adorned_entities.size())
+		{
+			difference = string_format("%s has %zu rows recorded, %zu replayed", type_def->name.c_str(), type_def->adorned_entities.size(), other.adorned_entities.size());
+			return false;
+		}
+
+		for (std::size_t row = 0; row < type_def->adorned_entities.size(); row++)
+		{
+			auto entity = type_def->adorned_entities.at(row);
+			auto mapped = replay.entity((std::uint32_t)entt::to_integral(entity));
+			if (mapped == entt::null || !other.adorned_entities.contains(mapped))
+			{
+				difference = string_format("%s of instance %u was not replayed", type_def->name.c_str(), entt::to_integral(entity));
+				return false;
+			}
+
+			auto other_row = other.row_of(mapped);
+			for (std::size_t m = 0; m < type_def->columns.size(); m++)
+			{
+				if (!journal_members_match(check, type_def->members[m].kind, type_def->columns[m].read(row), other.columns[m].read(other_row)))
+				{
+					difference = string_format("%s.%s of instance %u differs", type_def->name.c_str(), type_def->members[m].name.c_str(), entt::to_integral(entity));
+					return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
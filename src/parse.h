@@ -13,8 +13,12 @@
 #include <sstream>
 #include <cstdarg>
 #include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
 
 #include "ecs.h"
+#include "pool.h"
 
 std::string string_format(const std::string fmt_str, ...) 
 {
@@ -58,6 +62,7 @@ enum class EToken
 	Mult,
 	Div,
 	Mod,
+	PlusAssign,
 	True,
 	False,
 	Lt, Le, Eq, Ne, Ge, Gt,
@@ -84,6 +89,18 @@ enum class EKeyword
 	Get,
 	To,
 	From,
+	Changed,
+	On,
+	Update,
+	Referencing,
+	Where,
+	Prefab,
+	Compact,
+	Explain,
+	Parallel,
+	First,
+	Count,
+	Any,
 };
 
 struct Token
@@ -154,6 +171,7 @@ std::string stringify_token(EToken token)
 	case EToken::Mult: return "mult";
 	case EToken::Div: return "div";
 	case EToken::Mod: return "mod";
+	case EToken::PlusAssign: return "+=";
 	case EToken::True: return "true";	
 	case EToken::Lt: return "<";
 	case EToken::Le: return "<=";
@@ -184,10 +202,34 @@ std::string stringify_keyword(EKeyword keyword)
 	case EKeyword::Get: return "get";
 	case EKeyword::To: return "to";
 	case EKeyword::From: return "from";
+	case EKeyword::Changed: return "changed";
+	case EKeyword::On: return "on";
+	case EKeyword::Update: return "update";
+	case EKeyword::Referencing: return "referencing";
+	case EKeyword::Where: return "where";
+	case EKeyword::Prefab: return "prefab";
+	case EKeyword::Compact: return "compact";
+	case EKeyword::Explain: return "explain";
+	case EKeyword::Parallel: return "parallel";
+	case EKeyword::First: return "first";
+	case EKeyword::Count: return "count";
+	case EKeyword::Any: return "any";
 	case EKeyword::Print: default: return "print";
 	}
 }
 
+// the interned tables are not thread-safe: while a parallel foreach has workers running, whatever
+// reads or grows them from a statement holds this
+struct /* InternedLockSingleton */ {
+	std::recursive_mutex mutex;
+	bool shared = false;
+
+	std::unique_lock<std::recursive_mutex> hold()
+	{
+		return shared ? std::unique_lock<std::recursive_mutex>(mutex) : std::unique_lock<std::recursive_mutex>();
+	}
+} InternedLock;
+
 struct /* InternedStringsSingleton */ {
 	std::size_t index = 0;
 	std::unordered_map<std::size_t, std::string> interned_strings_index;
@@ -265,6 +307,35 @@ struct InternedCollectionsSingleton {
 	std::unordered_map<std::string, std::size_t> interned_collection_index;
 	std::vector<std::size_t> freed_indices;
 
+	// collections below this index may be reachable from more than one forked world, so the
+	// operators that work in place copy them first
+	std::size_t shared_below = 0;
+	std::size_t live_forks = 0;
+
+	void begin_fork()
+	{
+		shared_below = interned_collection_values.size();
+		live_forks++;
+	}
+
+	void end_fork()
+	{
+		if (--live_forks == 0)
+		{
+			shared_below = 0;
+		}
+	}
+
+	std::size_t own_collection(std::size_t collection_index)
+	{
+		if (collection_index >= shared_below)
+			return collection_index;
+
+		auto index = create_collection();
+		interned_collection_values[index] = interned_collection_values[collection_index];
+		return index;
+	}
+
 	void assign_collection_name(std::size_t index, std::string name)
 	{
 		interned_collection_reindex[index] = name;
@@ -358,6 +429,7 @@ struct InternedCollectionsSingleton {
 
 	std::size_t sum_collection(std::size_t first_index, std::size_t second_index)
 	{
+		first_index = own_collection(first_index);
 		auto& first = interned_collection_values[first_index];
 		auto& second = interned_collection_values[second_index];
 
@@ -381,6 +453,7 @@ struct InternedCollectionsSingleton {
 
 std::string stringify_typed_value(TypedValue& tv)
 {
+	auto lock = InternedLock.hold();
 	switch (tv.type)
 	{
 	case EType::Null: return "null";
@@ -427,6 +500,7 @@ static const TypedValue operator+(const TypedValue& lhs, const TypedValue& rhs)
 		break;
 	case EType::String:
 	{
+		auto lock = InternedLock.hold();
 		res.type = EType::String;
 		auto ls = InternedStrings.get_string(lhs.data.intern_string_index).value_or(std::string{ "" });
 		auto rs = InternedStrings.get_string(rhs.data.intern_string_index).value_or(std::string{ "" });
@@ -435,8 +509,11 @@ static const TypedValue operator+(const TypedValue& lhs, const TypedValue& rhs)
 	}
 		break;
 	case EType::Collection:
+	{
+		auto lock = InternedLock.hold();
 		res.type = EType::Collection;
 		res.data.intern_collection_index = InternedCollections.sum_collection(lhs.data.intern_collection_index, rhs.data.intern_collection_index);
+	}
 		break;
 	}
 
@@ -463,8 +540,11 @@ static const TypedValue operator-(const TypedValue& lhs, const TypedValue& rhs)
 		res.data.float_value = lhs.data.float_value - rhs.data.float_value;
 		break;
 	case EType::Collection:
+	{
+		auto lock = InternedLock.hold();
 		res.type = EType::Collection;
 		res.data.intern_collection_index = InternedCollections.diff_collection(lhs.data.intern_collection_index, rhs.data.intern_collection_index);
+	}
 		break;
 	}
 
@@ -477,6 +557,7 @@ static const TypedValue operator*(const TypedValue& lhs, const TypedValue& rhs)
 
 	if (lhs.type == EType::String && rhs.type == EType::Int)
 	{
+		auto lock = InternedLock.hold();
 		res.type = EType::String;
 		std::string val = InternedStrings.get_string(lhs.data.intern_string_index).value_or(std::string{ "" });
 		std::string result = "";
@@ -507,8 +588,11 @@ static const TypedValue operator*(const TypedValue& lhs, const TypedValue& rhs)
 			res.data.float_value = lhs.data.float_value * rhs.data.float_value;
 			break;
 		case EType::Collection:
+		{
+			auto lock = InternedLock.hold();
 			res.type = EType::Collection;
 			res.data.intern_collection_index = InternedCollections.intersect_collection(lhs.data.intern_collection_index, rhs.data.intern_collection_index);
+		}
 			break;
 		}
 	}
@@ -661,6 +745,7 @@ LOGICAL_OP(>);
 
 std::size_t InternedCollectionsSingleton::diff_collection(std::size_t first_index, std::size_t second_index)
 {
+	first_index = own_collection(first_index);
 	auto& first = interned_collection_values[first_index];
 	auto& second = interned_collection_values[second_index];
 	Collection remaining;
@@ -687,6 +772,7 @@ std::size_t InternedCollectionsSingleton::diff_collection(std::size_t first_inde
 
 std::size_t InternedCollectionsSingleton::intersect_collection(std::size_t first_index, std::size_t second_index)
 {
+	first_index = own_collection(first_index);
 	auto& first = interned_collection_values[first_index];
 	auto& second = interned_collection_values[second_index];
 	Collection common;
@@ -720,14 +806,38 @@ struct InterpretError
 	Statement* statement;
 };
 
+// a `+=` that the rows of one task of a parallel foreach made, summed over those rows. `entity` is null
+// when the target is a variable, else the target is member `member` of that entity's `type`
+struct Reduction
+{
+	std::string name;
+	entt::entity entity = entt::null;
+	entt::entity type = entt::null;
+	int member = 0;
+	TypedValue value;
+};
+
 struct System
 {
 	std::string name;
 	std::vector<std::shared_ptr<Statement>> block;
 
+	// world tick at the end of this system's previous run; `changed` filters compare against it
+	std::uint32_t last_run = 0;
+
 	System(std::string name, std::vector<std::shared_ptr<Statement>> block);
 };
 
+enum class EParallel
+{
+	// the rows are shared out among the threads of the pool
+	Pool,
+	// the same tasks, run in row order on the calling thread, to tell scheduling apart from other bugs
+	Serial,
+	// on the pool, failing if two rows write the same component or one destroys what another writes
+	Checked,
+};
+
 struct Context
 {
 	std::shared_ptr<ECS> ecs;
@@ -743,7 +853,42 @@ struct Context
 	std::vector<System> systems;
 	int depth = 0;
 
+	// attach/detach/destroy issued while a foreach walks its rows are recorded here and
+	// flushed when the outermost foreach ends
+	CommandBuffer commands;
+	int iterating = 0;
+
+	// tick the running system last ran at; outside of systems every component counts as changed
+	std::uint32_t last_run_tick = 0;
+
+	// observer definitions run so far, replayed against the world of a fork
+	std::vector<Statement*> observers;
+	// what those registered with the world; they run on this context, so they are taken back with it
+	std::vector<std::tuple<TypeHandle, EObserverEvent, std::size_t>> registered_observers;
+	bool forked = false;
+
+	// prefab declarations, resolved against the world when they ran
+	std::unordered_map<std::string, Prefab> prefabs;
+
+	// how `parallel foreach` runs, and on how many threads (0 for one per hardware thread)
+	EParallel parallel_mode = EParallel::Pool;
+	std::size_t parallel_workers = 0;
+	std::unique_ptr<WorkPool> pool;
+
+	// set on the workers of a parallel foreach: `+=` adds to these sums rather than to its target,
+	// and attaching one of `in_place` to an instance that has it already rewrites its row there and then,
+	// keeping the row as it was in `rewritten`
+	std::vector<Reduction>* reductions = nullptr;
+	const std::vector<TypeHandle>* in_place = nullptr;
+	RewriteLog* rewritten = nullptr;
+
+	bool is_deferring() const
+	{
+		return iterating > 0;
+	}
+
 	Context();
+	explicit Context(std::shared_ptr<ECS> world);
 	~Context();
 
 	bool is_parse_okay();
@@ -758,6 +903,13 @@ struct Context
 	void execute();
 
 	void update();
+
+	// applies the deferred commands, and drops the names of every instance they destroyed
+	void flush_commands();
+
+	std::unique_ptr<Context> fork();
+
+	WorkPool& work_pool();
 	
 	void make_interpret_error(std::string err, Statement* statement)
 	{
@@ -895,6 +1047,7 @@ struct StringExpr : public Expr
 
 	std::string to_string(Context& ctx) override
 	{
+		auto lock = InternedLock.hold();
 		return std::string("\"") + InternedStrings.get_string(interned_index).value() + std::string("\"");
 	}
 };
@@ -915,6 +1068,7 @@ struct CollectionExpr : public Expr
 
 	TypedValue eval(Context& ctx) override
 	{
+		auto lock = InternedLock.hold();
 		TypedValue v;
 		v.type = EType::Collection;
 		
@@ -931,6 +1085,7 @@ struct CollectionExpr : public Expr
 			{
 				InternedCollections.add_collection_value(collection_index.value(), el->eval(ctx));
 			}
+			v.data.intern_collection_index = collection_index.value();
 		}
 		
 		return v;
@@ -938,6 +1093,7 @@ struct CollectionExpr : public Expr
 
 	std::string to_string(Context& ctx) override
 	{
+		auto lock = InternedLock.hold();
 		auto& coll = InternedCollections.get_collection_by_index(collection_index.value());
 		std::string str = "[ ";
 		for (auto& e : coll)
@@ -950,6 +1106,27 @@ struct CollectionExpr : public Expr
 	}
 };
 
+std::shared_ptr<Expr> make_member_expr(const ComponentMember& value)
+{
+	switch (value.kind)
+	{
+	case EComponentMember::Bool:
+		return std::shared_ptr<Expr>(new BoolExpr(value.data.b.value));
+	case EComponentMember::Int:
+		return std::shared_ptr<Expr>(new IntExpr(value.data.i.value));
+	case EComponentMember::Float:
+		return std::shared_ptr<Expr>(new FloatExpr(value.data.f.value));
+	case EComponentMember::EntityRef:
+		return std::shared_ptr<Expr>(new EntityExpr(value.data.e.value));
+	case EComponentMember::String:
+		return std::shared_ptr<Expr>(new StringExpr(value.data.s.index));
+	case EComponentMember::Collection:
+		return std::shared_ptr<Expr>(new CollectionExpr(value.data.c.index));
+	default:
+		return nullptr;
+	}
+}
+
 struct CompMemberRefExpr : public Expr
 {
 	std::string name;
@@ -974,7 +1151,7 @@ struct CompMemberRefExpr : public Expr
 
 	std::string to_string(Context& ctx) override
 	{
-		auto& type = ctx.ecs->registry.get<ComponentType>(comp.type_id);
+		auto& type = ecs_get_type(*ctx.ecs, comp.type_id);
 		return value->to_string(ctx) + " [@" + std::to_string(entt::to_integral((uint64_t)entity)) + "] " + type.name + "::" + name;
 	}
 };
@@ -1094,6 +1271,12 @@ struct Scope
 		next.reset();
 	}
 
+	// bound expressions are values and can be shared; the chain of nested scopes cannot
+	Scope(const Scope& other)
+		: env(other.env)
+		, next(other.next ? std::make_shared<Scope>(*other.next) : nullptr)
+	{}
+
 	void add_binding(std::string name, std::shared_ptr<Expr> value)
 	{
 		if (next)
@@ -1106,6 +1289,33 @@ struct Scope
 		}
 	}
 
+	// like add_binding, but replaces a binding of the same name in the innermost scope
+	void set_binding(std::string name, std::shared_ptr<Expr> value)
+	{
+		if (next)
+		{
+			next->set_binding(name, value);
+		}
+		else
+		{
+			env[name] = value;
+		}
+	}
+
+	// replaces the innermost binding of `name`, in whichever scope holds it; false if there is none
+	bool update_binding(std::string name, std::shared_ptr<Expr> value)
+	{
+		if (next && next->update_binding(name, value))
+			return true;
+
+		auto found = env.find(name);
+		if (found == env.end())
+			return false;
+
+		found->second = value;
+		return true;
+	}
+
 	std::optional<entt::entity> internal_rec_delete_binding(std::string name)
 	{
 		if (next)
@@ -1137,9 +1347,9 @@ struct Scope
 		{
 			if (env.count(name) > 0)
 			{
-				auto e = env.find(name);
+				auto val = env.find(name)->second;
 				env.erase(name);
-				if (EntityExpr* ee = dynamic_cast<EntityExpr*>(e->second.get()))
+				if (EntityExpr* ee = dynamic_cast<EntityExpr*>(val.get()))
 				{
 					return std::make_optional(ee->r.value);
 				}
@@ -1149,6 +1359,8 @@ struct Scope
 				return std::nullopt;
 			}
 		}
+
+		return std::nullopt;
 	}
 
 	void internal_rec_delete_refs(entt::entity e)
@@ -1183,6 +1395,48 @@ struct Scope
 		}
 	}
 
+	// internal_rec_delete_refs for every one of `removed`, in one pass over the scopes
+	void internal_rec_delete_refs(std::vector<entt::entity> removed)
+	{
+		if (removed.empty())
+			return;
+
+		std::sort(removed.begin(), removed.end());
+		internal_rec_delete_sorted_refs(removed);
+	}
+
+	void internal_rec_delete_sorted_refs(const std::vector<entt::entity>& removed)
+	{
+		std::vector<std::string> to_delete;
+		for (auto& kv : env)
+		{
+			if (EntityExpr* ee = dynamic_cast<EntityExpr*>(kv.second.get()))
+			{
+				if (std::binary_search(removed.begin(), removed.end(), ee->r.value))
+				{
+					to_delete.push_back(kv.first);
+				}
+			}
+			else if (CompMemberRefExpr* ref = dynamic_cast<CompMemberRefExpr*>(kv.second.get()))
+			{
+				if (std::binary_search(removed.begin(), removed.end(), ref->entity))
+				{
+					to_delete.push_back(kv.first);
+				}
+			}
+		}
+
+		for (auto& key : to_delete)
+		{
+			env.erase(key);
+		}
+
+		if (next)
+		{
+			next->internal_rec_delete_sorted_refs(removed);
+		}
+	}
+
 	void internal_rec_delete_comp_ref(entt::entity e, entt::entity comp_type_id)
 	{
 		std::vector<std::string> to_delete;
@@ -1296,9 +1550,26 @@ Context::Context()
 	ecs = std::make_shared<ECS>();
 }
 
+Context::Context(std::shared_ptr<ECS> world)
+{
+	scope = new Scope();
+	ecs = world;
+}
+
 Context::~Context()
 {
+	// the world may be shared and outlive this context, but its observers must not
+	for (auto [handle, kind, id] : registered_observers)
+	{
+		ecs_unobserve(*ecs, handle, kind, id);
+	}
+
 	delete scope;
+
+	if (forked)
+	{
+		InternedCollections.end_fork();
+	}
 }
 
 std::optional<ParseError> generic_parse_error = std::nullopt;
@@ -1342,6 +1613,15 @@ struct Statement
 	Token start, end;
 	virtual void execute(Context& ctx) = 0;
 
+	// the block of a parallel foreach runs on several threads at once, so only statements that read the
+	// world and defer their writes may appear in it. they resolve whatever they cache here, up front, so
+	// the workers only ever read it; false, with an error, for anything else
+	virtual bool prepare_parallel(Context& ctx)
+	{
+		ctx.make_interpret_error("Only attach, detach, destroy, get, if and += can run in a parallel foreach", this);
+		return false;
+	}
+
 	Statement(Token start, Token end)
 		: start(start)
 		, end(end)
@@ -1352,13 +1632,31 @@ void Context::update()
 {
 	for (auto& system : systems)
 	{
+		this->last_run_tick = system.last_run;
+
 		this->depth++;
 		for (auto& statement : system.block)
 		{
 			statement->execute(*this);
 		}
 		this->depth--;
+
+		flush_commands();
+		ecs_dispatch_events(*ecs);
+
+		// a system does not see its own writes as changes next time, but every later one does
+		system.last_run = ecs->change_tick;
+		ecs_advance_tick(*ecs);
 	}
+
+	this->last_run_tick = 0;
+}
+
+void Context::flush_commands()
+{
+	std::vector<instance_entity> removed;
+	ecs_flush_commands(*ecs, commands, &removed);
+	scope->internal_rec_delete_refs(std::move(removed));
 }
 
 void Context::execute()
@@ -1366,6 +1664,8 @@ void Context::execute()
 	for (auto stat : interpreted_statements)
 	{
 		stat->execute(*this);
+		ecs_dispatch_events(*ecs);
+
 		if (has_errors())
 		{
 			die_with_error();
@@ -1374,6 +1674,53 @@ void Context::execute()
 	}
 }
 
+// a context over a copy-on-write fork of this world, with its own bindings, systems and observers;
+// only valid between top-level statements. the two share their statements: what those cache is kept
+// per world by the ECS (registered queries), holds in every world of the lineage (type handles and
+// member slots, as no world defines types while it has forks) or lasts one run, so the contexts
+// may take turns but not run at once
+std::unique_ptr<Context> Context::fork()
+{
+	assert(depth == 0 && iterating == 0 && commands.empty());
+
+	auto child = std::make_unique<Context>();
+	child->ecs = ecs_fork(*ecs);
+	delete child->scope;
+	child->scope = new Scope(*scope);
+
+	child->source_lines = source_lines;
+	child->source_text = source_text;
+	child->interpreted_statements = interpreted_statements;
+	child->parse_error = parse_error;
+	child->interpret_error = interpret_error;
+	child->systems = systems;
+	child->prefabs = prefabs;
+	child->parallel_mode = parallel_mode;
+	child->parallel_workers = parallel_workers;
+
+	child->forked = true;
+	InternedCollections.begin_fork();
+
+	for (auto observer : observers)
+	{
+		observer->execute(*child);
+	}
+
+	return child;
+}
+
+// made on first use, and again if parallel_workers has changed since
+WorkPool& Context::work_pool()
+{
+	auto workers = parallel_workers ? parallel_workers : std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+	if (!pool || pool->size() != workers)
+	{
+		pool = std::make_unique<WorkPool>(workers);
+	}
+
+	return *pool;
+}
+
 void Context::die_with_error()
 {
 	if (this->parse_error.has_value())
@@ -1456,6 +1803,23 @@ struct IfStatement : public Statement
 			ctx.depth--;
 		}
 	}
+
+	bool prepare_parallel(Context& ctx) override
+	{
+		for (auto& statement : then_branch)
+		{
+			if (!statement->prepare_parallel(ctx))
+				return false;
+		}
+
+		for (auto& statement : else_branch)
+		{
+			if (!statement->prepare_parallel(ctx))
+				return false;
+		}
+
+		return true;
+	}
 };
 
 struct DefineSystemStatement : public Statement
@@ -1485,12 +1849,14 @@ struct DefineSystemStatement : public Statement
 struct DefineComponentStatement : public Statement
 {
 	std::string comp_name;
-	std::vector<std::tuple<std::string, EType>> members;
+	std::vector<std::tuple<std::string, EType, ERefPolicy>> members;
+	std::vector<std::tuple<std::string, EMemberIndex>> indexes;
 
-	DefineComponentStatement(Range range, std::string name, std::vector<std::tuple<std::string, EType>> mems)
+	DefineComponentStatement(Range range, std::string name, std::vector<std::tuple<std::string, EType, ERefPolicy>> mems, std::vector<std::tuple<std::string, EMemberIndex>> indexes = {})
 		: Statement(std::get<0>(range), std::get<1>(range))
 		, comp_name(name)
 		, members(mems)
+		, indexes(indexes)
 	{}
 
 	void execute(Context& ctx) override
@@ -1502,349 +1868,619 @@ struct DefineComponentStatement : public Statement
 			return;
 		}
 
-		std::vector<std::tuple<std::string, EComponentMember>> comp_members;
-		for (auto& [k, v] : members)
+		// statements resolve component types once and may run in any world of the lineage
+		if (ecs_has_forks(*ctx.ecs))
+		{
+			ctx.make_interpret_error(string_format("Cannot define component %s while the world has forks", comp_name.c_str()), this);
+			return;
+		}
+
+		std::vector<ComponentMemberDefinition> comp_members;
+		for (auto& [k, v, on_destroy] : members)
 		{
 			switch (v)
 			{
 			case EType::Bool: comp_members.push_back({ k, EComponentMember::Bool }); break;
-			case EType::Entity: comp_members.push_back({ k, EComponentMember::EntityRef }); break;
+			case EType::Entity: comp_members.push_back({ k, EComponentMember::EntityRef, on_destroy }); break;
 			case EType::Int: comp_members.push_back({ k, EComponentMember::Int }); break;
 			case EType::Float: comp_members.push_back({ k, EComponentMember::Float }); break;
 			case EType::String: comp_members.push_back({ k, EComponentMember::String }); break;
 			case EType::Collection: comp_members.push_back({ k, EComponentMember::Collection }); break;
 			}
 		}
-		ecs_create_type(*ctx.ecs, comp_name, comp_members);
-	}
-};
-
-struct CreateEntityStatement : public Statement
-{
-	std::string entity_name;
-	std::vector<CompCtor> components;
-
-	CreateEntityStatement(Range range, std::string name, std::vector<CompCtor> flds)
-		: Statement(std::get<0>(range), std::get<1>(range))
-		, entity_name(name)
-		, components(flds)
-	{}
-
-	void execute(Context& ctx) override
-	{
-		if (ctx.has_errors()) return;
-
-		auto e = ecs_create_instance(*ctx.ecs);
-		ctx.scope->add_binding(entity_name, std::shared_ptr<Expr>(new EntityExpr(e)));
 
-		for (auto& ctor : components)
+		for (auto& [member_name, index] : indexes)
 		{
-			auto& type = ecs_get_type(*ctx.ecs, ctor.comp_name);
-			ecs_adorn_instance(*ctx.ecs, e, ctor.comp_name);
-			auto& comp = ecs_get_component_by_instance(*ctx.ecs, e, ctor.comp_name);
-			
-			int i = 0;
-			for (auto& [member_name, value] : ctor.fields)
+			auto member = std::find_if(comp_members.begin(), comp_members.end(), [&](auto& def) { return def.name == member_name; });
+			if (member == comp_members.end())
 			{
-				auto& typed_val = value->eval(ctx);
-				if (typed_val.type == EType::Collection)
-				{
-					typed_val.data.intern_collection_index = dynamic_cast<CollectionExpr*>(value.get())->collection_index.value();
-				}
-
-				switch (type.members[i].kind)
-				{
-				case EComponentMember::Bool:
-					if (typed_val.type != EType::Bool)
-					{
-						ctx.make_interpret_error(string_format("Expected bool, got %s", stringify_type(typed_val.type).c_str()), this);
-						return;
-					}
-					ecs_set_member_in_component(comp, member_name, Bool{ typed_val.data.bool_value });
-					break;
-				case EComponentMember::Int:
-					if (typed_val.type != EType::Int)
-					{
-						ctx.make_interpret_error(string_format("Expected int, got %s", stringify_type(typed_val.type).c_str()), this);
-						return;
-					}
-					ecs_set_member_in_component(comp, member_name, Int{ typed_val.data.int_value });
-					break;
-				case EComponentMember::Float:
-					if (typed_val.type != EType::Float)
-					{
-						ctx.make_interpret_error(string_format("Expected float, got %s", stringify_type(typed_val.type).c_str()), this);
-						return;
-					}
-					ecs_set_member_in_component(comp, member_name, Float{ typed_val.data.float_value });
-					break;
-				case EComponentMember::EntityRef:
-					if (typed_val.type != EType::Entity)
-					{
-						ctx.make_interpret_error(string_format("Expected entity ref, got %s", stringify_type(typed_val.type).c_str()), this);
-						return;
-					}
-					ecs_set_member_in_component(comp, member_name, EntityRef{ typed_val.data.entity_value });
-					break;
-				case EComponentMember::String:
-					if (typed_val.type != EType::String)
-					{
-						ctx.make_interpret_error(string_format("Expected string, got %s", stringify_type(typed_val.type).c_str()), this);
-						return;
-					}
-					ecs_set_member_in_component(comp, member_name, InternedString{ typed_val.data.intern_string_index });
-					break;
-				case EComponentMember::Collection:
-					if (typed_val.type != EType::Collection)
-					{
-						ctx.make_interpret_error(string_format("Expected collection, got %s", stringify_type(typed_val.type).c_str()), this);
-						return;
-					}
-					ecs_set_member_in_component(comp, member_name, InternedCollection{ typed_val.data.intern_collection_index });
-					break;
-				}
+				ctx.make_interpret_error(string_format("Cannot index unknown member %s of %s", member_name.c_str(), comp_name.c_str()), this);
+				return;
+			}
 
-				i++;
+			if (index == EMemberIndex::Ordered && member->kind != EComponentMember::Int && member->kind != EComponentMember::Float)
+			{
+				ctx.make_interpret_error(string_format("Only int and float members can have an ordered index, %s of %s cannot", member_name.c_str(), comp_name.c_str()), this);
+				return;
 			}
+			member->index = index;
+		}
+
+		// a loaded snapshot may have defined the type already; the same definition is kept as it is
+		auto existing = ecs_get_type_handle(*ctx.ecs, comp_name);
+		if (existing.is_valid())
+		{
+			auto& defined = ecs_get_type(*ctx.ecs, existing).members;
+			auto same = std::equal(defined.begin(), defined.end(), comp_members.begin(), comp_members.end(), [](auto& a, auto& b) {
+				return a.name == b.name && a.kind == b.kind && a.on_destroy == b.on_destroy && a.index == b.index;
+			});
+
+			if (!same)
+				ctx.make_interpret_error(string_format("Component %s is already defined with other members", comp_name.c_str()), this);
+			return;
 		}
+
+		ecs_create_type(*ctx.ecs, comp_name, comp_members);
 	}
 };
 
-struct DestroyEntityStatement : public Statement
+bool make_component_member(Context& ctx, Statement* statement, EComponentMember kind, const TypedValue& typed_val, ComponentMember& member)
 {
-	std::string entity_name;
-
-	DestroyEntityStatement(Range range, std::string entity_name)
-		: Statement(std::get<0>(range), std::get<1>(range))
-		, entity_name(entity_name)
-	{}
-
-	void execute(Context& ctx) override
+	switch (kind)
 	{
-		if (ctx.has_errors()) return;
-
-		auto entity = ctx.scope->get_binding(entity_name);
-		if (!entity)
+	case EComponentMember::Bool:
+		if (typed_val.type != EType::Bool)
 		{
-			ctx.make_interpret_error(string_format("Variable '%s' not found", entity_name.c_str()), this);
-			return;
+			ctx.make_interpret_error(string_format("Expected bool, got %s", stringify_type(typed_val.type).c_str()), statement);
+			return false;
 		}
-
-		auto val = entity->eval(ctx);
-		if (val.type != EType::Entity)
+		member = ecs_make_member(Bool{ typed_val.data.bool_value });
+		break;
+	case EComponentMember::Int:
+		if (typed_val.type != EType::Int)
 		{
-			ctx.make_interpret_error(string_format("Entity expected, but %s found instead", stringify_type(val.type).c_str()), this);
-			return;
+			ctx.make_interpret_error(string_format("Expected int, got %s", stringify_type(typed_val.type).c_str()), statement);
+			return false;
+		}
+		member = ecs_make_member(Int{ typed_val.data.int_value });
+		break;
+	case EComponentMember::Float:
+		if (typed_val.type != EType::Float)
+		{
+			ctx.make_interpret_error(string_format("Expected float, got %s", stringify_type(typed_val.type).c_str()), statement);
+			return false;
+		}
+		member = ecs_make_member(Float{ typed_val.data.float_value });
+		break;
+	case EComponentMember::EntityRef:
+		if (typed_val.type != EType::Entity)
+		{
+			ctx.make_interpret_error(string_format("Expected entity ref, got %s", stringify_type(typed_val.type).c_str()), statement);
+			return false;
+		}
+		member = ecs_make_member(EntityRef{ typed_val.data.entity_value });
+		break;
+	case EComponentMember::String:
+		if (typed_val.type != EType::String)
+		{
+			ctx.make_interpret_error(string_format("Expected string, got %s", stringify_type(typed_val.type).c_str()), statement);
+			return false;
 		}
+		member = ecs_make_member(InternedString{ typed_val.data.intern_string_index });
+		break;
+	case EComponentMember::Collection:
+		if (typed_val.type != EType::Collection)
+		{
+			ctx.make_interpret_error(string_format("Expected collection, got %s", stringify_type(typed_val.type).c_str()), statement);
+			return false;
+		}
+		member = ecs_make_member(InternedCollection{ typed_val.data.intern_collection_index });
+		break;
+	}
+
+	return true;
+}
 
-		ecs_destroy_instance(*ctx.ecs, val.data.entity_value);
-		ctx.scope->delete_binding(entity_name);
+TypedValue eval_member_value(Context& ctx, std::shared_ptr<Expr>& value)
+{
+	auto typed_val = value->eval(ctx);
+	if (typed_val.type == EType::Collection)
+	{
+		if (auto coll = dynamic_cast<CollectionExpr*>(value.get()))
+		{
+			auto lock = InternedLock.hold();
+			typed_val.data.intern_collection_index = coll->collection_index.value();
+		}
 	}
-};
 
-struct PrintContextStatement : public Statement
+	return typed_val;
+}
+
+// evaluates a constructor's fields into member values, appended to `values`; false on a type mismatch
+bool eval_ctor_values(Context& ctx, Statement* statement, CompCtor& ctor, const std::vector<MemberSlot>& slots, std::vector<MemberValue>& values)
 {
-	PrintContextStatement(Range range) 
-		: Statement(std::get<0>(range), std::get<1>(range)) 
-	{}
+	for (std::size_t i = 0; i < ctor.fields.size(); i++)
+	{
+		auto typed_val = eval_member_value(ctx, std::get<1>(ctor.fields[i]));
 
-	void execute(Context& ctx) override
-	{		
-		if (ctx.has_errors()) return;
+		MemberValue value{ slots[i], {} };
+		if (!make_component_member(ctx, statement, slots[i].kind, typed_val, value.value))
+			return false;
 
-		ctx.scope->print(ctx);
-		printf("\n");
+		values.push_back(value);
 	}
-};
 
+	return true;
+}
 
-struct GetStatement : public Statement
+// resolves component names to type handles once; false if a component is not defined
+bool compile_type_handles(Context& ctx, Statement* statement, const std::vector<std::string>& names, std::vector<TypeHandle>& handles)
 {
-	std::string entity_name;
-	std::vector<CompParamCtor> components;
+	if (handles.size() == names.size()) return true;
 
-	GetStatement(Range range, std::string name, std::vector<CompParamCtor> comps)
+	handles.clear();
+	for (auto& name : names)
+	{
+		auto handle = ecs_get_type_handle(*ctx.ecs, name);
+		if (!handle.is_valid())
+		{
+			ctx.make_interpret_error(string_format("Unknown component %s", name.c_str()), statement);
+			handles.clear();
+			return false;
+		}
+		handles.push_back(handle);
+	}
+
+	return true;
+}
+
+// resolves the type and member slots of each constructor once; false if either does not exist
+bool compile_ctors(Context& ctx, Statement* statement, std::vector<CompCtor>& ctors, std::vector<TypeHandle>& handles, std::vector<std::vector<MemberSlot>>& slots)
+{
+	if (handles.size() == ctors.size()) return true;
+
+	std::vector<std::string> names;
+	for (auto& ctor : ctors)
+	{
+		names.push_back(ctor.comp_name);
+	}
+
+	if (!compile_type_handles(ctx, statement, names, handles)) return false;
+
+	slots.clear();
+	for (std::size_t c = 0; c < ctors.size(); c++)
+	{
+		auto& type_def = ecs_get_type(*ctx.ecs, handles[c]);
+		std::vector<MemberSlot> ctor_slots;
+		for (auto& [member_name, value] : ctors[c].fields)
+		{
+			auto slot = ecs_get_member_slot(type_def, member_name);
+			if (!slot.is_valid())
+			{
+				ctx.make_interpret_error(string_format("Component %s has no member '%s'", ctors[c].comp_name.c_str(), member_name.c_str()), statement);
+				handles.clear();
+				return false;
+			}
+			ctor_slots.push_back(slot);
+		}
+		slots.push_back(ctor_slots);
+	}
+
+	return true;
+}
+
+// the prefab a create names, provided every constructor overrides one of its components; nullptr on an error
+const Prefab* resolve_prefab(Context& ctx, Statement* statement, const std::string& prefab_name, std::vector<CompCtor>& ctors, const std::vector<TypeHandle>& handles)
+{
+	auto found = ctx.prefabs.find(prefab_name);
+	if (found == ctx.prefabs.end())
+	{
+		ctx.make_interpret_error(string_format("Unknown prefab %s", prefab_name.c_str()), statement);
+		return nullptr;
+	}
+
+	for (std::size_t c = 0; c < ctors.size(); c++)
+	{
+		if (!found->second.signature.test(handles[c]))
+		{
+			ctx.make_interpret_error(string_format("Prefab %s has no component %s to override", prefab_name.c_str(), ctors[c].comp_name.c_str()), statement);
+			return nullptr;
+		}
+	}
+
+	return &found->second;
+}
+
+// what a create inside a foreach defers making: the prefab's types and values, if there is one,
+// followed by those of the constructors, which override them
+std::shared_ptr<const SpawnShape> make_spawn_shape(const Prefab* prefab, const std::vector<TypeHandle>& handles, const std::vector<MemberValue>& values)
+{
+	auto shape = std::make_shared<SpawnShape>();
+	if (prefab)
+	{
+		shape->types = prefab->types;
+		shape->values = prefab->values;
+	}
+
+	shape->types.insert(shape->types.end(), handles.begin(), handles.end());
+	shape->values.insert(shape->values.end(), values.begin(), values.end());
+	return shape;
+}
+
+// inside a foreach the new entity is only reserved, and made with its components once the rows are done
+struct CreateEntityStatement : public Statement
+{
+	std::string entity_name;
+	std::vector<CompCtor> components;
+	std::vector<TypeHandle> handles;
+	std::vector<std::vector<MemberSlot>> slots;
+
+	// with a prefab, `components` only override some of its members
+	std::string prefab_name;
+
+	CreateEntityStatement(Range range, std::string name, std::vector<CompCtor> flds, std::string prefab_name = "")
 		: Statement(std::get<0>(range), std::get<1>(range))
-		, entity_name{ name }
-		, components{ comps }
+		, entity_name(name)
+		, components(flds)
+		, prefab_name(prefab_name)
 	{}
 
 	void execute(Context& ctx) override
 	{
 		if (ctx.has_errors()) return;
+		if (!compile_ctors(ctx, this, components, handles, slots)) return;
 
-		auto e = ctx.scope->get_binding(entity_name);
-		if (!e)
+		const Prefab* prefab = nullptr;
+		if (!prefab_name.empty())
 		{
-			ctx.make_interpret_error(string_format("Variable '%s' not found", entity_name.c_str()), this);
+			prefab = resolve_prefab(ctx, this, prefab_name, components, handles);
+			if (!prefab) return;
+		}
+
+		if (prefab || ctx.is_deferring())
+		{
+			std::vector<MemberValue> values;
+			for (std::size_t c = 0; c < components.size(); c++)
+			{
+				if (!eval_ctor_values(ctx, this, components[c], slots[c], values))
+					return;
+			}
+
+			instance_entity e;
+			if (ctx.is_deferring())
+			{
+				auto reserved = ecs_reserve_instances(*ctx.ecs, 1);
+				ecs_defer_create(ctx.commands, reserved, make_spawn_shape(prefab, handles, values));
+				e = reserved.front();
+			}
+			else
+			{
+				e = ecs_spawn(*ctx.ecs, *prefab, 1, values).front();
+			}
+
+			ctx.scope->add_binding(entity_name, std::shared_ptr<Expr>(new EntityExpr(e)));
 			return;
 		}
 
-		auto entity = dynamic_cast<EntityExpr*>(e.get());
-		if (!entity)
+		auto e = ecs_create_instance(*ctx.ecs);
+		ctx.scope->add_binding(entity_name, std::shared_ptr<Expr>(new EntityExpr(e)));
+
+		for (std::size_t c = 0; c < components.size(); c++)
 		{
-			ctx.make_interpret_error(string_format("Expected entity reference, got %s instead.", e->to_string(ctx).c_str()), this);
+			std::vector<MemberValue> values;
+			if (!eval_ctor_values(ctx, this, components[c], slots[c], values))
+				return;
+
+			ecs_adorn_instance(*ctx.ecs, e, handles[c], values);
+		}
+	}
+};
+
+// "create 1000 enemies with ..." evaluates the constructor once and binds the new entities as one
+// collection; inside a foreach they are reserved and made like a single create's
+struct CreateEntitiesStatement : public Statement
+{
+	std::shared_ptr<Expr> count;
+	std::string collection_name;
+	std::vector<CompCtor> components;
+	std::vector<TypeHandle> handles;
+	std::vector<std::vector<MemberSlot>> slots;
+	std::string prefab_name;
+
+	CreateEntitiesStatement(Range range, std::shared_ptr<Expr> count, std::string name, std::vector<CompCtor> flds, std::string prefab_name = "")
+		: Statement(std::get<0>(range), std::get<1>(range))
+		, count(count)
+		, collection_name(name)
+		, components(flds)
+		, prefab_name(prefab_name)
+	{}
+
+	void execute(Context& ctx) override
+	{
+		if (ctx.has_errors()) return;
+		if (!compile_ctors(ctx, this, components, handles, slots)) return;
+
+		const Prefab* prefab = nullptr;
+		if (!prefab_name.empty())
+		{
+			prefab = resolve_prefab(ctx, this, prefab_name, components, handles);
+			if (!prefab) return;
+		}
+
+		auto n = count->eval(ctx);
+		if (n.type != EType::Int || n.data.int_value < 0)
+		{
+			ctx.make_interpret_error(string_format("Entity count must be a non-negative int, %s found instead", stringify_type(n.type).c_str()), this);
 			return;
 		}
 
-		ctx.scope->push_scope();
+		std::vector<MemberValue> values;
+		for (std::size_t c = 0; c < components.size(); c++)
+		{
+			if (!eval_ctor_values(ctx, this, components[c], slots[c], values))
+				return;
+		}
 
-		for (auto& comp_ctor : components)
+		std::vector<instance_entity> entities;
+		if (ctx.is_deferring())
 		{
-			const auto& comp = ecs_get_component_by_instance(*ctx.ecs, entity->r.value, comp_ctor.comp_name);
-			int index = 0;
-			for (auto& var_param : comp_ctor.params)
+			entities = ecs_reserve_instances(*ctx.ecs, n.data.int_value);
+			ecs_defer_create(ctx.commands, entities, make_spawn_shape(prefab, handles, values));
+		}
+		else
+		{
+			entities = prefab
+				? ecs_spawn(*ctx.ecs, *prefab, n.data.int_value, values)
+				: ecs_create_instances(*ctx.ecs, n.data.int_value, handles, values);
+		}
+
+		if (!collection_name.empty())
+		{
+			auto collection = InternedCollections.create_collection();
+			for (auto entity : entities)
 			{
-				if (VarExpr* var = dynamic_cast<VarExpr*>(var_param.get()))
-				{
-					auto& name = var->name;
-					auto& value = comp.members[index];
+				TypedValue v;
+				v.type = EType::Entity;
+				v.data.entity_value = entity;
+				InternedCollections.add_collection_value(collection, v);
+			}
 
-					std::shared_ptr<Expr> expr_value = nullptr;
+			ctx.scope->add_binding(collection_name, std::shared_ptr<Expr>(new CollectionExpr(collection)));
+		}
+	}
+};
 
-					switch (value.kind)
-					{
-					case EComponentMember::Bool:
-						expr_value.reset(new BoolExpr(value.data.b.value));
-						break;
-					case EComponentMember::Int:
-						expr_value.reset(new IntExpr(value.data.i.value));
-						break;
-					case EComponentMember::Float:
-						expr_value.reset(new FloatExpr(value.data.f.value));
-						break;
-					case EComponentMember::EntityRef:
-						expr_value.reset(new EntityExpr(value.data.e.value));
-						break;
-					case EComponentMember::String:
-						expr_value.reset(new StringExpr(value.data.s.index));
-						break;
-					case EComponentMember::Collection:
-						expr_value.reset(new CollectionExpr(value.data.c.index));
-						break;
-					}
+// "prefab Goblin with Position(x: 0, y: 0), Mass(kg: 3);" evaluates its members once, for every later
+// "create g from Goblin;" to copy
+struct DefinePrefabStatement : public Statement
+{
+	std::string prefab_name;
+	std::vector<CompCtor> components;
+	std::vector<TypeHandle> handles;
+	std::vector<std::vector<MemberSlot>> slots;
 
-					std::shared_ptr<Expr> ref_expr(new CompMemberRefExpr(name, entity->r.value, comp, index, expr_value));
-					ctx.scope->add_binding(name, ref_expr);
-				}
-				else
+	DefinePrefabStatement(Range range, std::string name, std::vector<CompCtor> flds)
+		: Statement(std::get<0>(range), std::get<1>(range))
+		, prefab_name(name)
+		, components(flds)
+	{}
+
+	void execute(Context& ctx) override
+	{
+		if (ctx.has_errors()) return;
+		if (!compile_ctors(ctx, this, components, handles, slots)) return;
+
+		std::vector<MemberValue> values;
+		for (std::size_t c = 0; c < components.size(); c++)
+		{
+			if (!eval_ctor_values(ctx, this, components[c], slots[c], values))
+				return;
+		}
+
+		ctx.prefabs[prefab_name] = ecs_make_prefab(*ctx.ecs, handles, values);
+	}
+};
+
+struct DestroyEntityStatement : public Statement
+{
+	std::vector<std::string> entity_names;
+
+	DestroyEntityStatement(Range range, std::vector<std::string> entity_names)
+		: Statement(std::get<0>(range), std::get<1>(range))
+		, entity_names(entity_names)
+	{}
+
+	void execute(Context& ctx) override
+	{
+		if (ctx.has_errors()) return;
+
+		std::vector<instance_entity> entities;
+		for (auto& entity_name : entity_names)
+		{
+			auto entity = ctx.scope->get_binding(entity_name);
+			if (!entity)
+			{
+				ctx.make_interpret_error(string_format("Variable '%s' not found", entity_name.c_str()), this);
+				return;
+			}
+
+			auto val = entity->eval(ctx);
+			if (val.type == EType::Collection)
+			{
+				auto lock = InternedLock.hold();
+				for (auto& el : InternedCollections.get_collection_by_index(val.data.intern_collection_index))
 				{
-					if (dynamic_cast<VarExpr*>(var_param.get()) != nullptr)
-					{
-						ctx.make_interpret_error(string_format("Expected variable name."), this);
-						return;
-					}
+					if (el.type == EType::Entity)
+						entities.push_back(el.data.entity_value);
 				}
+				continue;
+			}
 
-				index++;
+			if (val.type != EType::Entity)
+			{
+				ctx.make_interpret_error(string_format("Entity expected, but %s found instead", stringify_type(val.type).c_str()), this);
+				return;
+			}
+
+			if (!ctx.ecs->registry.valid(val.data.entity_value))
+			{
+				ctx.make_interpret_error(string_format("Entity '%s' was already destroyed", entity_name.c_str()), this);
+				return;
+			}
+
+			entities.push_back(val.data.entity_value);
+		}
+
+		// a cascade takes out instances that may be bound too, under names of their own
+		std::vector<instance_entity> removed;
+		if (ctx.is_deferring())
+		{
+			for (auto entity : entities)
+			{
+				ecs_defer_destroy(ctx.commands, entity);
 			}
 		}
+		else if (entities.size() == 1 && entity_names.size() == 1)
+		{
+			ecs_destroy_instance(*ctx.ecs, entities[0], &removed);
+		}
+		else
+		{
+			ecs_destroy_instances(*ctx.ecs, entities, &removed);
+		}
+
+		for (auto& entity_name : entity_names)
+		{
+			ctx.scope->delete_binding(entity_name);
+		}
+		ctx.scope->internal_rec_delete_refs(std::move(removed));
+	}
+
+	bool prepare_parallel(Context&) override
+	{
+		return true;
 	}
 };
 
-struct AttachStatement : public Statement
+struct PrintContextStatement : public Statement
 {
-	std::string entity_name;
-	std::vector<CompCtor> components;
+	PrintContextStatement(Range range) 
+		: Statement(std::get<0>(range), std::get<1>(range)) 
+	{}
 
-	AttachStatement(Range range, std::string name, std::vector<CompCtor> comps)
+	void execute(Context& ctx) override
+	{		
+		if (ctx.has_errors()) return;
+
+		ctx.scope->print(ctx);
+		printf("\n");
+	}
+};
+
+struct PrintMemoryStatement : public Statement
+{
+	PrintMemoryStatement(Range range)
 		: Statement(std::get<0>(range), std::get<1>(range))
-		, entity_name{name}
-		, components{comps}
 	{}
 
 	void execute(Context& ctx) override
 	{
 		if (ctx.has_errors()) return;
 
-		auto e = ctx.scope->get_binding(entity_name);
-		if (!e)
+		std::size_t tagged = 0, packed = 0;
+		for (auto& report : ecs_memory_report(*ctx.ecs))
 		{
-			ctx.make_interpret_error(string_format("Variable '%s' not found", entity_name.c_str()), this);
-			return;
+			auto& type_def = ecs_get_type(*ctx.ecs, report.type);
+			printf(" %s: %zu rows, %zu bytes packed (%zu per row), %zu bytes tagged, %zu saved\n",
+				type_def.name.c_str(), report.rows, report.packed_bytes, type_def.layout.packed_size, report.tagged_bytes, report.saved_bytes());
+
+			tagged += report.tagged_bytes;
+			packed += report.packed_bytes;
 		}
 
-		auto entity = dynamic_cast<EntityExpr*>(e.get());
-		if (!entity)
+		printf(" total: %zu bytes packed, %zu bytes tagged, %zu saved\n\n", packed, tagged, tagged - packed);
+	}
+};
+
+// "compact;" re-packs all storage, "compact 10000;" about that many rows of it and leaves the rest for later
+struct CompactStatement : public Statement
+{
+	std::shared_ptr<Expr> budget;
+
+	CompactStatement(Range range, std::shared_ptr<Expr> budget)
+		: Statement(std::get<0>(range), std::get<1>(range))
+		, budget(budget)
+	{}
+
+	void execute(Context& ctx) override
+	{
+		if (ctx.has_errors()) return;
+
+		if (ctx.is_deferring())
 		{
-			ctx.make_interpret_error(string_format("Expected entity reference, got %s instead.", e->to_string(ctx).c_str()), this);
+			ctx.make_interpret_error("Cannot compact while a foreach is walking the rows", this);
 			return;
 		}
 
-		for (auto& ctor : components)
+		auto rows = ~std::size_t(0);
+		if (budget)
 		{
-			auto& type = ecs_get_type(*ctx.ecs, ctor.comp_name);
-			ecs_adorn_instance(*ctx.ecs, entity->r.value, ctor.comp_name);
-			auto& comp = ecs_get_component_by_instance(*ctx.ecs, entity->r.value, ctor.comp_name);
-
-			int i = 0;
-			for (auto& [member_name, value] : ctor.fields)
+			auto n = budget->eval(ctx);
+			if (n.type != EType::Int || n.data.int_value < 0)
 			{
-				auto& typed_val = value->eval(ctx);
-
-				switch (type.members[i].kind)
-				{
-				case EComponentMember::Int:
-					if (typed_val.type != EType::Int)
-					{
-						ctx.make_interpret_error(string_format("Expected int, got %s", stringify_type(typed_val.type).c_str()), this);
-						return;
-					}
-					ecs_set_member_in_component(comp, member_name, Int{ typed_val.data.int_value });
-					break;
-				case EComponentMember::Float:
-					if (typed_val.type != EType::Float)
-					{
-						ctx.make_interpret_error(string_format("Expected float, got %s", stringify_type(typed_val.type).c_str()), this);
-						return;
-					}
-					ecs_set_member_in_component(comp, member_name, Float{ typed_val.data.float_value });
-					break;
-				case EComponentMember::EntityRef:
-					if (typed_val.type != EType::Entity)
-					{
-						ctx.make_interpret_error(string_format("Expected entity ref, got %s", stringify_type(typed_val.type).c_str()), this);
-						return;
-					}
-					ecs_set_member_in_component(comp, member_name, EntityRef{ typed_val.data.entity_value });
-					break;
-				case EComponentMember::String:
-					if (typed_val.type != EType::String)
-					{
-						ctx.make_interpret_error(string_format("Expected string, got %s", stringify_type(typed_val.type).c_str()), this);
-						return;
-					}
-					ecs_set_member_in_component(comp, member_name, InternedString{ typed_val.data.intern_string_index });
-					break;
-				case EComponentMember::Collection:
-					if (typed_val.type != EType::Collection)
-					{
-						ctx.make_interpret_error(string_format("Expected collection, got %s", stringify_type(typed_val.type).c_str()), this);
-						return;
-					}
-					ecs_set_member_in_component(comp, member_name, InternedCollection{ typed_val.data.intern_collection_index });
-					break;
-				}
-				i++;
+				ctx.make_interpret_error(string_format("Compaction budget must be a non-negative int, %s found instead", stringify_type(n.type).c_str()), this);
+				return;
 			}
+			rows = n.data.int_value;
 		}
+
+		auto report = ecs_compact(*ctx.ecs, rows);
+		printf(" compacted %zu types, %zu rows moved, %zu bytes reclaimed (%zu -> %zu)%s\n\n",
+			report.types_compacted, report.rows_moved, report.reclaimed_bytes(), report.bytes_before, report.bytes_after, report.done ? "" : ", more to do");
 	}
 };
 
-struct DetachStatement : public Statement
+
+// binds each named parameter of `ctor` to the matching member of `comp`; `_` placeholders are skipped
+void bind_component_params(Context& ctx, instance_entity entity, const Component& comp, const CompParamCtor& ctor)
+{
+	int index = 0;
+	for (auto& var_param : ctor.params)
+	{
+		if (VarExpr* var = dynamic_cast<VarExpr*>(var_param.get()))
+		{
+			auto expr_value = make_member_expr(ecs_get_member_in_component(comp, index));
+			std::shared_ptr<Expr> ref_expr(new CompMemberRefExpr(var->name, entity, comp, index, expr_value));
+			ctx.scope->add_binding(var->name, ref_expr);
+		}
+
+		index++;
+	}
+}
+
+struct GetStatement : public Statement
 {
 	std::string entity_name;
-	std::vector<std::string> components;
+	std::vector<CompParamCtor> components;
 
-	DetachStatement(Range range, std::string name, std::vector<std::string> comps)
+	std::vector<std::string> component_names;
+	std::vector<TypeHandle> handles;
+
+	GetStatement(Range range, std::string name, std::vector<CompParamCtor> comps)
 		: Statement(std::get<0>(range), std::get<1>(range))
 		, entity_name{ name }
 		, components{ comps }
-	{}
+	{
+		for (auto& comp : components)
+		{
+			component_names.push_back(comp.comp_name);
+		}
+	}
 
 	void execute(Context& ctx) override
 	{
 		if (ctx.has_errors()) return;
+		if (!compile_type_handles(ctx, this, component_names, handles)) return;
 
 		auto e = ctx.scope->get_binding(entity_name);
 		if (!e)
@@ -1860,115 +2496,1271 @@ struct DetachStatement : public Statement
 			return;
 		}
 
-		for (auto& comp : components)
+		if (!ctx.ecs->registry.valid(entity->r.value))
+		{
+			ctx.make_interpret_error(string_format("Entity '%s' was already destroyed", entity_name.c_str()), this);
+			return;
+		}
+
+		for (std::size_t c = 0; c < components.size(); c++)
+		{
+			if (!ecs_has_component(*ctx.ecs, entity->r.value, handles[c]))
+			{
+				ctx.make_interpret_error(string_format("Entity '%s' has no component %s", entity_name.c_str(), component_names[c].c_str()), this);
+				return;
+			}
+		}
+
+		ctx.scope->push_scope();
+
+		for (std::size_t c = 0; c < components.size(); c++)
+		{
+			const auto comp = ecs_get_component_by_instance(*ctx.ecs, entity->r.value, handles[c]);
+			bind_component_params(ctx, entity->r.value, comp, components[c]);
+		}
+	}
+
+	bool prepare_parallel(Context& ctx) override
+	{
+		return compile_type_handles(ctx, this, component_names, handles);
+	}
+};
+
+// "on attach Mass(kg) to e { }", "on update Position(x, y) to e { }", "on detach Foo from e { }"
+struct DefineObserverStatement : public Statement
+{
+	EObserverEvent kind;
+	CompParamCtor component;
+	std::string entity_name;
+	std::vector<std::shared_ptr<Statement>> block;
+
+	TypeHandle handle;
+
+	DefineObserverStatement(Range range, EObserverEvent kind, CompParamCtor comp, std::string name, std::vector<std::shared_ptr<Statement>> block)
+		: Statement(std::get<0>(range), std::get<1>(range))
+		, kind(kind)
+		, component(comp)
+		, entity_name(name)
+		, block(block)
+	{}
+
+	void execute(Context& ctx) override
+	{
+		if (ctx.has_errors()) return;
+		if (ctx.depth > 0)
+		{
+			ctx.make_interpret_error(string_format("Cannot define observer within system or query"), this);
+			return;
+		}
+
+		handle = ecs_get_type_handle(*ctx.ecs, component.comp_name);
+		if (!handle.is_valid())
+		{
+			ctx.make_interpret_error(string_format("Component type '%s' not defined", component.comp_name.c_str()), this);
+			return;
+		}
+
+		if (kind == EObserverEvent::Detach && !component.params.empty())
+		{
+			ctx.make_interpret_error(string_format("Detach observers cannot bind members of %s", component.comp_name.c_str()), this);
+			return;
+		}
+
+		// the statement is kept alive by the interpreted statements of the context, and the observer
+		// is taken back when the context goes
+		Context* context = &ctx;
+		auto id = ecs_observe(*ctx.ecs, handle, kind, [this, context](ECS&, const std::vector<ObserverEvent>& events) {
+			run(*context, events);
+		});
+		ctx.registered_observers.push_back({ handle, kind, id });
+		ctx.observers.push_back(this);
+	}
+
+	void run(Context& ctx, const std::vector<ObserverEvent>& events)
+	{
+		for (auto& event : events)
+		{
+			if (ctx.has_errors()) return;
+
+			// the component may have gone again before the batch was dispatched
+			if (kind != EObserverEvent::Detach && !ecs_has_component(*ctx.ecs, event.entity, handle))
+				continue;
+
+			ctx.scope->push_scope();
+			ctx.scope->add_binding(entity_name, std::shared_ptr<EntityExpr>(new EntityExpr(event.entity)));
+
+			if (kind != EObserverEvent::Detach)
+			{
+				bind_component_params(ctx, event.entity, ecs_get_component_by_instance(*ctx.ecs, event.entity, handle), component);
+			}
+
+			ctx.depth++;
+			for (auto statement : block)
+			{
+				statement->execute(ctx);
+			}
+			ctx.depth--;
+			ctx.scope->pop_scope();
+		}
+	}
+};
+
+struct AttachStatement : public Statement
+{
+	std::string entity_name;
+	std::vector<CompCtor> components;
+	std::vector<TypeHandle> handles;
+	std::vector<std::vector<MemberSlot>> slots;
+
+	AttachStatement(Range range, std::string name, std::vector<CompCtor> comps)
+		: Statement(std::get<0>(range), std::get<1>(range))
+		, entity_name{name}
+		, components{comps}
+	{}
+
+	void execute(Context& ctx) override
+	{
+		if (ctx.has_errors()) return;
+		if (!compile_ctors(ctx, this, components, handles, slots)) return;
+
+		auto e = ctx.scope->get_binding(entity_name);
+		if (!e)
+		{
+			ctx.make_interpret_error(string_format("Variable '%s' not found", entity_name.c_str()), this);
+			return;
+		}
+
+		auto entity = dynamic_cast<EntityExpr*>(e.get());
+		if (!entity)
+		{
+			ctx.make_interpret_error(string_format("Expected entity reference, got %s instead.", e->to_string(ctx).c_str()), this);
+			return;
+		}
+
+		if (!ctx.ecs->registry.valid(entity->r.value))
+		{
+			ctx.make_interpret_error(string_format("Entity '%s' was already destroyed", entity_name.c_str()), this);
+			return;
+		}
+
+		for (std::size_t c = 0; c < components.size(); c++)
+		{
+			std::vector<MemberValue> values;
+			if (!eval_ctor_values(ctx, this, components[c], slots[c], values))
+				return;
+
+			if (ctx.in_place && std::find(ctx.in_place->begin(), ctx.in_place->end(), handles[c]) != ctx.in_place->end()
+				&& ecs_get_type(*ctx.ecs, handles[c]).adorned_entities.contains(entity->r.value))
+			{
+				ecs_rewrite_component(*ctx.ecs, entity->r.value, handles[c], values, ctx.rewritten);
+			}
+			else if (ctx.is_deferring())
+			{
+				ecs_defer_attach(ctx.commands, entity->r.value, handles[c], values);
+			}
+			else
+			{
+				ecs_adorn_instance(*ctx.ecs, entity->r.value, handles[c], values);
+			}
+		}
+	}
+
+	bool prepare_parallel(Context& ctx) override
+	{
+		return compile_ctors(ctx, this, components, handles, slots);
+	}
+};
+
+struct DetachStatement : public Statement
+{
+	std::string entity_name;
+	std::vector<std::string> components;
+	std::vector<TypeHandle> handles;
+
+	DetachStatement(Range range, std::string name, std::vector<std::string> comps)
+		: Statement(std::get<0>(range), std::get<1>(range))
+		, entity_name{ name }
+		, components{ comps }
+	{}
+
+	void execute(Context& ctx) override
+	{
+		if (ctx.has_errors()) return;
+		if (!compile_type_handles(ctx, this, components, handles)) return;
+
+		auto e = ctx.scope->get_binding(entity_name);
+		if (!e)
+		{
+			ctx.make_interpret_error(string_format("Variable '%s' not found", entity_name.c_str()), this);
+			return;
+		}
+
+		auto entity = dynamic_cast<EntityExpr*>(e.get());
+		if (!entity)
+		{
+			ctx.make_interpret_error(string_format("Expected entity reference, got %s instead.", e->to_string(ctx).c_str()), this);
+			return;
+		}
+
+		if (!ctx.ecs->registry.valid(entity->r.value))
+		{
+			ctx.make_interpret_error(string_format("Entity '%s' was already destroyed", entity_name.c_str()), this);
+			return;
+		}
+
+		for (auto handle : handles)
+		{
+			if (ctx.is_deferring())
+			{
+				ecs_defer_detach(ctx.commands, entity->r.value, handle);
+			}
+			else
+			{
+				ecs_unadorn_instance(*ctx.ecs, entity->r.value, handle);
+			}
+			ctx.scope->internal_rec_delete_comp_ref(entity->r.value, ecs_get_type_id(*ctx.ecs, handle));
+		}
+	}
+
+	bool prepare_parallel(Context& ctx) override
+	{
+		return compile_type_handles(ctx, this, components, handles);
+	}
+};
+
+// adds `reduction.value` to its target, in ctx's scope and, for a member, in the world; false, with
+// an error, if the target is gone or cannot be added to
+bool apply_reduction(Context& ctx, Statement* statement, const Reduction& reduction)
+{
+	auto binding = ctx.scope->get_binding(reduction.name);
+	if (reduction.entity == entt::null)
+	{
+		if (!binding)
+		{
+			ctx.make_interpret_error(string_format("Variable '%s' not found", reduction.name.c_str()), statement);
+			return false;
+		}
+
+		auto sum = binding->eval(ctx) + reduction.value;
+		switch (sum.type)
+		{
+		case EType::Int:
+			ctx.scope->update_binding(reduction.name, std::shared_ptr<Expr>(new IntExpr(sum.data.int_value)));
+			return true;
+		case EType::Float:
+			ctx.scope->update_binding(reduction.name, std::shared_ptr<Expr>(new FloatExpr(sum.data.float_value)));
+			return true;
+		case EType::Bool:
+			ctx.scope->update_binding(reduction.name, std::shared_ptr<Expr>(new BoolExpr(sum.data.bool_value)));
+			return true;
+		default:
+			ctx.make_interpret_error(string_format("Cannot add %s to '%s'", stringify_type(reduction.value.type).c_str(), reduction.name.c_str()), statement);
+			return false;
+		}
+	}
+
+	auto& ecs = *ctx.ecs;
+	auto& type_def = ecs_get_type(ecs, reduction.type);
+	if (!ecs.registry.valid(reduction.entity) || !type_def.adorned_entities.contains(reduction.entity))
+	{
+		ctx.make_interpret_error(string_format("Cannot add to '%s', @%u no longer has %s",
+			reduction.name.c_str(), entt::to_integral(reduction.entity), type_def.name.c_str()), statement);
+		return false;
+	}
+
+	auto kind = type_def.columns[reduction.member].kind;
+	auto current = make_member_expr(type_def.columns[reduction.member].read(type_def.row_of(reduction.entity)));
+	ComponentMember member;
+	if (!make_component_member(ctx, statement, kind, current->eval(ctx) + reduction.value, member))
+		return false;
+
+	Component comp{ reduction.entity, type_def.id, &type_def };
+	ecs_set_member_in_component(comp, MemberSlot{ type_def.id, (std::uint8_t)reduction.member, kind }, member);
+
+	// the binding is a copy of the member's value, so it is made again from the new one
+	auto ref = dynamic_cast<CompMemberRefExpr*>(binding.get());
+	if (ref && ref->entity == reduction.entity && ref->comp.type_id == reduction.type && ref->param_index == reduction.member)
+	{
+		ctx.scope->update_binding(reduction.name, std::shared_ptr<Expr>(new CompMemberRefExpr(reduction.name, reduction.entity, comp, reduction.member, make_member_expr(member))));
+	}
+
+	return true;
+}
+
+// `total += x;` adds to a variable, or to a component member bound by foreach or get. ints, floats and
+// bools (for which + is `or`) can be added to. in a parallel foreach the rows of each task are summed
+// apart and the sums added to the targets in task order once all of them are done, so the result does
+// not depend on the threads; until then the rows read the targets as they were before the loop
+struct ReduceStatement : public Statement
+{
+	std::string name;
+	std::shared_ptr<Expr> value;
+
+	ReduceStatement(Range range, std::string name, std::shared_ptr<Expr> value)
+		: Statement(std::get<0>(range), std::get<1>(range))
+		, name(name)
+		, value(value)
+	{}
+
+	void execute(Context& ctx) override
+	{
+		if (ctx.has_errors()) return;
+
+		auto target = ctx.scope->get_binding(name);
+		if (!target)
+		{
+			ctx.make_interpret_error(string_format("Variable '%s' not found", name.c_str()), this);
+			return;
+		}
+
+		auto delta = value->eval(ctx);
+		auto current = target->eval(ctx);
+		if (delta.type != current.type || (delta.type != EType::Int && delta.type != EType::Float && delta.type != EType::Bool))
+		{
+			ctx.make_interpret_error(string_format("Cannot add %s to %s '%s'",
+				stringify_type(delta.type).c_str(), stringify_type(current.type).c_str(), name.c_str()), this);
+			return;
+		}
+
+		Reduction reduction{ name, entt::null, entt::null, 0, delta };
+		if (CompMemberRefExpr* ref = dynamic_cast<CompMemberRefExpr*>(target.get()))
+		{
+			reduction.entity = ref->entity;
+			reduction.type = ref->comp.type_id;
+			reduction.member = ref->param_index;
+		}
+
+		if (!ctx.reductions)
+		{
+			apply_reduction(ctx, this, reduction);
+			return;
+		}
+
+		for (auto& partial : *ctx.reductions)
+		{
+			if (partial.entity == reduction.entity && partial.member == reduction.member && partial.type == reduction.type && partial.name == name)
+			{
+				partial.value = partial.value + delta;
+				return;
+			}
+		}
+
+		ctx.reductions->push_back(reduction);
+	}
+
+	bool prepare_parallel(Context&) override
+	{
+		return true;
+	}
+};
+
+std::string trim(const std::string& s);
+
+// whether evaluating `expr` reads any of `names`
+bool expr_mentions(Expr* expr, const std::vector<std::string>& names)
+{
+	if (VarExpr* var = dynamic_cast<VarExpr*>(expr))
+	{
+		return std::find(names.begin(), names.end(), var->name) != names.end();
+	}
+	else if (LogicalExpr* logical = dynamic_cast<LogicalExpr*>(expr))
+	{
+		return expr_mentions(logical->lhs.get(), names) || expr_mentions(logical->rhs.get(), names);
+	}
+	else if (ArithExpr* arith = dynamic_cast<ArithExpr*>(expr))
+	{
+		return expr_mentions(arith->lhs.get(), names) || expr_mentions(arith->rhs.get(), names);
+	}
+	else if (CollectionExpr* collection = dynamic_cast<CollectionExpr*>(expr))
+	{
+		for (auto& element : collection->elements)
+		{
+			if (expr_mentions(element.get(), names))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+// what a query statement does with the rows it finds
+enum class EQueryForm
+{
+	// runs the block for every row, or for the first one only
+	Each,
+	First,
+	// binds its name to how many rows there are, or whether there is any
+	Count,
+	Any,
+};
+
+// how a query found its rows, printed after it by `explain foreach ...`
+struct QueryPlan
+{
+	std::string access;
+	std::string filters;
+	std::size_t estimated = 0;
+	std::size_t visited = 0;
+	std::size_t ran = 0;
+};
+
+// picks where the rows of a query come from. walking the matched archetypes is the plan to beat:
+// every row it visits is a match but for `changed` and `where`. a narrower source of instances wins
+// if it yields fewer of them, and then the signature test rejects the rest, `without` included, in
+// one go. the world keeps the query's non-empty archetypes current, so empty ones cost nothing here
+struct QueryPlanner
+{
+	// `where m == value` or `where m < value` (and the other comparisons but !=), where m is a member of
+	// a positive component and value does not depend on the row, can go straight to the matching
+	// instances if that member has a fitting index; `op` reads as `m op value`
+	struct WhereLookup
+	{
+		std::size_t component;
+		std::size_t member;
+		ELogical op;
+		std::shared_ptr<Expr> value;
+	};
+	std::optional<WhereLookup> lookup;
+
+	// looks for the lookup once, when the query is made
+	void plan_where(const std::shared_ptr<Expr>& where, const std::string& entity_name, const std::vector<CompParamCtor>& positive_components)
+	{
+		LogicalExpr* logical = dynamic_cast<LogicalExpr*>(where.get());
+		if (!logical || logical->op == ELogical::Ne)
+			return;
+
+		std::vector<std::string> row_names{ entity_name };
+		for (auto& comp : positive_components)
+		{
+			for (auto& param : comp.params)
+			{
+				if (VarExpr* var = dynamic_cast<VarExpr*>(param.get()))
+					row_names.push_back(var->name);
+			}
+		}
+
+		auto flipped = logical->op;
+		switch (logical->op)
+		{
+		case ELogical::Lt: flipped = ELogical::Gt; break;
+		case ELogical::Le: flipped = ELogical::Ge; break;
+		case ELogical::Ge: flipped = ELogical::Le; break;
+		case ELogical::Gt: flipped = ELogical::Lt; break;
+		default: break;
+		}
+
+		for (auto [column, op, value] : { std::tuple{ logical->lhs, logical->op, logical->rhs }, std::tuple{ logical->rhs, flipped, logical->lhs } })
+		{
+			VarExpr* var = dynamic_cast<VarExpr*>(column.get());
+			if (!var || expr_mentions(value.get(), row_names))
+				continue;
+
+			for (std::size_t k = 0; k < positive_components.size(); k++)
+			{
+				auto& params = positive_components[k].params;
+				for (std::size_t member = 0; member < params.size(); member++)
+				{
+					VarExpr* param = dynamic_cast<VarExpr*>(params[member].get());
+					if (param && param->name == var->name)
+					{
+						lookup = WhereLookup{ k, member, op, value };
+						return;
+					}
+				}
+			}
+		}
+	}
+
+	// fills `plan` for this run and, when something narrower than the matched archetypes is known, puts
+	// the only instances to visit in `candidates`; `where_applied` if they all hold for `where` already.
+	// false on errors, which `statement` reports
+	bool plan_rows(Context& ctx, Statement* statement, const ArchetypeQuery& query, const std::vector<TypeHandle>& positive_handles,
+		Expr* referenced, bool explain, QueryPlan& plan, std::optional<std::vector<instance_entity>>& candidates, bool& where_applied)
+	{
+		auto& ecs = *ctx.ecs;
+		auto scan_rows = ecs_query_size(ecs, query);
+
+		// the plan is only put into words for explain
+		plan.estimated = scan_rows;
+		plan.visited = 0;
+		plan.ran = 0;
+		if (explain)
+			plan.access = string_format("scan of %zu archetypes", query.active.size());
+
+		if (referenced)
+		{
+			auto value = referenced->eval(ctx);
+			if (value.type != EType::Entity)
+			{
+				ctx.make_interpret_error(string_format("Expected entity after referencing, got %s", stringify_type(value.type).c_str()), statement);
+				return false;
+			}
+
+			candidates.emplace();
+			for (auto& ref : ecs_get_referrers(ecs, value.data.entity_value))
+			{
+				candidates->push_back(ref.source);
+			}
+			candidates->erase(std::unique(candidates->begin(), candidates->end()), candidates->end());
+
+			if (explain)
+				plan.access = "referrers of the target";
+			plan.estimated = candidates->size();
+		}
+		else if (lookup.has_value())
+		{
+			auto& type_def = ecs_get_type(ecs, positive_handles[lookup->component]);
+			auto index = ecs_get_member_index(type_def, lookup->member);
+			if (index && (lookup->op == ELogical::Eq || index->kind == EMemberIndex::Ordered))
+			{
+				ComponentMember member;
+				if (!make_component_member(ctx, statement, type_def.columns[lookup->member].kind, lookup->value->eval(ctx), member)) return false;
+
+				std::vector<instance_entity> found;
+				if (lookup->op == ELogical::Eq)
+				{
+					found = ecs_find_instances(ecs, type_def.handle, lookup->member, member, scan_rows);
+				}
+				else
+				{
+					MemberRange range;
+					if (lookup->op == ELogical::Lt || lookup->op == ELogical::Le)
+					{
+						range.upper = member;
+						range.upper_inclusive = lookup->op == ELogical::Le;
+					}
+					else
+					{
+						range.lower = member;
+						range.lower_inclusive = lookup->op == ELogical::Ge;
+					}
+
+					found = ecs_find_instances(ecs, type_def.handle, lookup->member, range, scan_rows);
+				}
+
+				auto narrows = found.size() < scan_rows;
+				if (explain)
+				{
+					auto index_name = string_format("%s index on %s.%s", index->kind == EMemberIndex::Ordered ? "ordered" : "hash",
+						type_def.name.c_str(), type_def.members[lookup->member].name.c_str());
+					plan.access = narrows ? index_name : plan.access + string_format("; %s would not narrow it", index_name.c_str());
+				}
+
+				if (narrows)
+				{
+					plan.estimated = found.size();
+					candidates = std::move(found);
+					where_applied = true;
+				}
+			}
+		}
+
+		return true;
+	}
+};
+
+struct QueryEntitiesStatement;
+
+// `parallel foreach`: the tasks are run by the workers of ctx's pool, each with its own copy of the
+// bindings and its own command buffer. the buffers are appended to ctx.commands in row order after
+// all of them are done, so the world ends up just as a plain foreach would leave it: every row
+// reads the world as it was before the loop, and of several writes to one component the last
+// row's wins. `+=` is summed per task and the sums added up in task order after the buffers, and
+// where no row could tell the difference a row's own components are rewritten in place rather
+// than deferred (see BlockWrites). the one other difference is that collections are copied
+// rather than grown in place
+struct ParallelForeach
+{
+	// the rows are cut into tasks of at most a chunk each, from archetype `archetype`
+	// or, with NoSlot there, from the candidates; the worker that ran a task left its commands at
+	// [begin, end) of its buffer, summed the `+=` of its rows in `reductions` and kept the rows it
+	// rewrote in place as they were in `rewritten`
+	struct Task
+	{
+		std::size_t archetype;
+		std::size_t first;
+		std::size_t worker = 0;
+		std::size_t begin = 0;
+		std::size_t end = 0;
+		std::optional<InterpretError> error;
+		std::vector<Reduction> reductions;
+		RewriteLog rewritten;
+
+		Task(std::size_t archetype, std::size_t first)
+			: archetype(archetype)
+			, first(first)
+		{}
+	};
+
+	struct Worker
+	{
+		std::unique_ptr<Context> ctx;
+		std::vector<std::pair<ComponentType*, std::size_t>> slots;
+		std::vector<std::pair<ComponentType*, std::size_t>> rows;
+		// the row each command in ctx->commands came from, kept when checking for races
+		std::vector<instance_entity> writers;
+		std::size_t visited = 0;
+		std::size_t ran = 0;
+	};
+
+	// what the block of a parallel foreach writes, gathered once. a type attached to the row's own
+	// instance and to no other can be rewritten in place by the workers, as no other row could tell:
+	// unless a row reads other instances with get, or a += adds to a member of the type, whose sum
+	// lands after the rows did
+	struct BlockWrites
+	{
+		bool gets = false;
+		std::vector<TypeHandle> to_row;
+		std::vector<TypeHandle> elsewhere;
+		std::vector<std::string> reduced;
+	};
+
+	QueryEntitiesStatement& loop;
+	bool prepared = false;
+	BlockWrites block_writes;
+	std::vector<TypeHandle> in_place;
+	std::vector<Task> tasks;
+	std::vector<Worker> workers;
+
+	explicit ParallelForeach(QueryEntitiesStatement& loop)
+		: loop(loop)
+	{}
+
+	// runs the block of `loop` for its rows, from `candidates` if there are any
+	void run(Context& ctx, const ArchetypeQuery& query, const std::optional<std::vector<instance_entity>>& candidates, bool check_where);
+
+	void gather_writes(const std::vector<std::shared_ptr<Statement>>& statements);
+
+	// picks the types the workers rewrite in place this run, which depends on the bindings and on
+	// what the world has set up (see ecs_prepare_concurrent_writes)
+	void plan_in_place(Context& ctx);
+
+	// whether a += of the block may add to a member of `handle`'s type: one bound by the row, or by
+	// the scope around the loop. a name bound by neither could be bound to anything
+	bool reduced_into(Context& ctx, TypeHandle handle);
+
+	void run_task(std::size_t w, std::size_t t, const ArchetypeQuery& query, const std::vector<instance_entity>* candidates, bool check_where, bool checked, std::atomic<std::size_t>& first_error);
+
+	// ends task `t` with the error its worker holds; the rows before keep their commands
+	void fail_task(Context& worker_ctx, std::size_t t, std::atomic<std::size_t>& first_error);
+
+	// rows are races when the outcome depends on their order: two of them writing the same component
+	// of an instance, or one destroying an instance another writes to
+	void check_races(Context& ctx, std::vector<std::tuple<instance_entity, std::uint32_t, instance_entity>>& writes);
+};
+
+struct QueryEntitiesStatement : public Statement
+{
+	std::string entity_name;
+	std::vector<CompParamCtor> positive_components;
+	std::vector<CompParamCtor> negative_components;
+
+	std::vector<std::string> positive_names;
+	std::vector<std::string> negative_names;
+	std::vector<std::shared_ptr<Statement>> block;
+
+	// indices into positive_components marked `changed`
+	std::vector<std::size_t> changed_components;
+
+	// `referencing t` walks only the instances with some ref member holding t
+	std::shared_ptr<Expr> referenced;
+
+	// rows for which `where` is not true are skipped
+	std::shared_ptr<Expr> where;
+
+	// how the last run found its rows, and where the next one will look
+	QueryPlanner planner;
+	QueryPlan plan;
+	bool explain = false;
+	EQueryForm form = EQueryForm::Each;
+
+	std::vector<TypeHandle> positive_handles;
+	std::vector<TypeHandle> negative_handles;
+	std::vector<std::pair<ComponentType*, std::size_t>> slots;
+	std::vector<std::pair<ComponentType*, std::size_t>> rows;
+
+	bool parallel = false;
+	ParallelForeach parallel_foreach{ *this };
+
+	QueryEntitiesStatement(Range range, std::string entity_name, std::vector<CompParamCtor> positive, std::vector<CompParamCtor> negative, std::vector<std::shared_ptr<Statement>> block, std::vector<std::size_t> changed = {}, std::shared_ptr<Expr> referenced = nullptr, std::shared_ptr<Expr> where = nullptr)
+		: Statement(std::get<0>(range), std::get<1>(range))
+		, entity_name(entity_name)
+		, positive_components(positive)
+		, negative_components(negative)
+		, block(block)
+		, changed_components(changed)
+		, referenced(referenced)
+		, where(where)
+	{
+		for (auto& comp : positive_components)
+		{
+			positive_names.push_back(comp.comp_name);
+		}
+
+		for (auto& comp : negative_components)
+		{
+			negative_names.push_back(comp.comp_name);
+		}
+
+		planner.plan_where(where, entity_name, positive_components);
+	}
+
+	void execute(Context& ctx) override
+	{
+		if (ctx.has_errors()) return;
+
+		auto& ecs = *ctx.ecs;
+		if (!compile_type_handles(ctx, this, positive_names, positive_handles)) return;
+		if (!compile_type_handles(ctx, this, negative_names, negative_handles)) return;
+		auto cached = ecs_cached_query(ecs, this, positive_handles, negative_handles);
+		auto& query = *cached;
+
+		for (auto k : changed_components)
+		{
+			if (ecs_get_type(ecs, positive_handles[k]).is_tag())
+			{
+				ctx.make_interpret_error(string_format("Tag %s has no members to change, observe it with 'on attach' instead", positive_names[k].c_str()), this);
+				return;
+			}
+		}
+
+		// when something narrower than the matched archetypes is known, only these instances are visited
+		std::optional<std::vector<instance_entity>> candidates;
+		bool where_applied = false;
+		if (!planner.plan_rows(ctx, this, query, positive_handles, referenced.get(), explain, plan, candidates, where_applied)) return;
+
+		// every structural change, creates included, waits in ctx.commands, so the rows walked
+		// here stay where they are until the outermost foreach is done
+		ctx.iterating++;
+
+		// first and any are done at the first row that runs the block
+		auto stops = form == EQueryForm::First || form == EQueryForm::Any;
+
+		if (parallel)
+		{
+			parallel_foreach.run(ctx, query, candidates, !where_applied);
+		}
+		else if ((form == EQueryForm::Count || form == EQueryForm::Any) && !candidates.has_value() && !where && changed_components.empty())
+		{
+			// every matched row counts, so the archetype sizes alone answer, as the estimate does without candidates
+			plan.ran = stops ? std::min<std::size_t>(plan.estimated, 1) : plan.estimated;
+		}
+		else if (candidates.has_value())
+		{
+			for (auto entity : candidates.value())
+			{
+				if (ctx.has_errors() || (stops && plan.ran > 0)) break;
+				plan.visited++;
+				if (!ecs.registry.valid(entity) || !ecs_query_matches(ecs, query, entity))
+					continue;
+
+				rows.clear();
+				for (auto handle : positive_handles)
+				{
+					auto& type_def = ecs_get_type(ecs, handle);
+					rows.push_back({ &type_def, type_def.row_of(entity) });
+				}
+
+				plan.ran += run_block(ctx, rows, entity, !where_applied);
+			}
+		}
+		else
+		{
+			auto it = ecs_iterate(ecs, query);
+			QueryChunk chunk;
+			auto archetype_index = Archetype::NoSlot;
+			while (!ctx.has_errors() && !(stops && plan.ran > 0) && ecs_next(it, chunk))
+			{
+				// tags have no rows to bind, only their type
+				if (chunk.archetype != archetype_index)
+				{
+					archetype_index = chunk.archetype;
+					slots.clear();
+					for (auto handle : positive_handles)
+					{
+						auto& type_def = ecs_get_type(ecs, handle);
+						slots.push_back({ &type_def, ecs.archetypes[archetype_index].slot_of(type_def.id) });
+					}
+				}
+
+				for (std::size_t i = 0; i < chunk.count && !(stops && plan.ran > 0); i++)
+				{
+					rows.clear();
+					for (auto [type_def, slot] : slots)
+					{
+						rows.push_back({ type_def, slot == Archetype::NoSlot ? 0 : chunk.chunk->rows[slot][i] });
+					}
+
+					plan.visited++;
+					plan.ran += run_block(ctx, rows, chunk.chunk->entities[i], true);
+				}
+			}
+		}
+
+		if (form == EQueryForm::Count)
+		{
+			ctx.scope->set_binding(entity_name, std::shared_ptr<Expr>(new IntExpr((int)plan.ran)));
+		}
+		else if (form == EQueryForm::Any)
+		{
+			ctx.scope->set_binding(entity_name, std::shared_ptr<Expr>(new BoolExpr(plan.ran > 0)));
+		}
+
+		if (--ctx.iterating == 0)
+		{
+			ctx.flush_commands();
+		}
+
+		if (explain)
+		{
+			print_plan(ctx, candidates.has_value(), where_applied);
+		}
+	}
+
+	void print_plan(Context& ctx, bool signature_checked, bool where_applied)
+	{
+		std::vector<std::string> filters;
+		if (signature_checked)
+			filters.push_back("signature");
+		for (auto k : changed_components)
+			filters.push_back("changed " + positive_names[k]);
+		if (where)
+			filters.push_back(where_applied ? "where (by the index)" : "where");
+
+		std::string joined;
+		for (auto& filter : filters)
+		{
+			joined += (joined.empty() ? "" : ", ") + filter;
+		}
+
+		// token lines count from 1
+		auto line = start.line >= 1 && start.line <= (int)ctx.source_lines.size() ? trim(ctx.source_lines[start.line - 1]) : "foreach " + entity_name;
+		printf(" plan: %s\n", line.c_str());
+		printf("  access: %s\n", plan.access.c_str());
+		printf("  filters: %s\n", joined.empty() ? "none" : joined.c_str());
+		printf("  rows: %zu estimated, %zu visited, %zu %s\n\n", plan.estimated, plan.visited, plan.ran,
+			form == EQueryForm::Count || form == EQueryForm::Any ? "matched" : "ran the block");
+	}
+
+	// binds `entity` and the members of its positive components, found at `row_refs`, and runs the block
+	// unless `changed` or `where` rule the row out; false if they did
+	bool run_block(Context& ctx, const std::vector<std::pair<ComponentType*, std::size_t>>& row_refs, instance_entity entity, bool check_where)
+	{
+		for (auto k : changed_components)
+		{
+			if (!row_refs[k].first->changed_since(row_refs[k].second, ctx.last_run_tick))
+				return false;
+		}
+
+		ctx.scope->push_scope();
+		// count and any bind their name to the answer instead, once the rows are done
+		if (form == EQueryForm::Each || form == EQueryForm::First)
+			ctx.scope->add_binding(entity_name, std::shared_ptr<EntityExpr>(new EntityExpr(entity)));
+
+		for (std::size_t k = 0; k < positive_components.size(); k++)
+		{
+			auto& comp_ctor = positive_components[k];
+			auto [type_def, row] = row_refs[k];
+			Component comp{ entity, type_def->id, type_def };
+
+			int index = 0;
+			for (auto& var_param : comp_ctor.params)
+			{
+				if (VarExpr* var = dynamic_cast<VarExpr*>(var_param.get()))
+				{
+					auto expr_value = make_member_expr(type_def->columns[index].read(row));
+					std::shared_ptr<Expr> ref_expr(new CompMemberRefExpr(var->name, entity, comp, index, expr_value));
+					ctx.scope->add_binding(var->name, ref_expr);
+				}
+
+				index++;
+			}
+		}
+
+		if (check_where && where)
+		{
+			auto cond = where->eval(ctx);
+			if (cond.type != EType::Bool)
+			{
+				ctx.make_interpret_error(string_format("Where condition must be a boolean, %s found instead", stringify_type(cond.type).c_str()), this);
+			}
+
+			if (cond.type != EType::Bool || !cond.data.bool_value)
+			{
+				ctx.scope->pop_scope();
+				return false;
+			}
+		}
+
+		ctx.depth++;
+		for (auto statement : block)
+		{
+			statement->execute(ctx);
+		}
+		ctx.depth--;
+		ctx.scope->pop_scope();
+		return true;
+	}
+};
+
+void ParallelForeach::run(Context& ctx, const ArchetypeQuery& query, const std::optional<std::vector<instance_entity>>& candidates, bool check_where)
+{
+	if (!prepared)
+	{
+		for (auto& statement : loop.block)
+		{
+			if (!statement->prepare_parallel(ctx))
+				return;
+		}
+		gather_writes(loop.block);
+		prepared = true;
+	}
+
+	auto& ecs = *ctx.ecs;
+	plan_in_place(ctx);
+	tasks.clear();
+	if (candidates.has_value())
+	{
+		for (std::size_t first = 0; first < candidates->size(); first += ArchetypeChunk::Capacity)
+		{
+			tasks.emplace_back(Archetype::NoSlot, first);
+		}
+	}
+	else
+	{
+		auto it = ecs_iterate(ecs, query);
+		QueryChunk chunk;
+		while (ecs_next(it, chunk))
+		{
+			tasks.emplace_back(chunk.archetype, chunk.first);
+		}
+	}
+
+	auto serial = ctx.parallel_mode == EParallel::Serial;
+	auto checked = ctx.parallel_mode == EParallel::Checked;
+	workers.resize(serial ? 1 : ctx.work_pool().size());
+	for (auto& worker : workers)
+	{
+		if (!worker.ctx)
+			worker.ctx = std::make_unique<Context>(ctx.ecs);
+
+		auto& worker_ctx = *worker.ctx;
+		worker_ctx.ecs = ctx.ecs;
+		delete worker_ctx.scope;
+		worker_ctx.scope = new Scope(*ctx.scope);
+		worker_ctx.commands.commands.clear();
+		worker_ctx.interpret_error.reset();
+		worker_ctx.iterating = 1;
+		worker_ctx.depth = ctx.depth;
+		worker_ctx.last_run_tick = ctx.last_run_tick;
+		worker_ctx.in_place = &in_place;
+		worker.writers.clear();
+		worker.visited = 0;
+		worker.ran = 0;
+	}
+
+	// collections are copied rather than changed in place, as they would be between forked worlds,
+	// so no row sees what another did to one
+	auto shared_below = InternedCollections.shared_below;
+	InternedCollections.shared_below = InternedCollections.interned_collection_values.size();
+	InternedLock.shared = workers.size() > 1;
+
+	// a failing row ends its task; the tasks after the first failing one need not run. a row that
+	// throws fails its task the same way, and its worker starts the next one from a clean scope
+	std::atomic<std::size_t> first_error{ tasks.size() };
+	auto job = [&](std::size_t worker, std::size_t task) {
+		try
+		{
+			run_task(worker, task, query, candidates.has_value() ? &candidates.value() : nullptr, check_where, checked, first_error);
+		}
+		catch (const std::exception& e)
+		{
+			auto& worker_ctx = *workers[worker].ctx;
+			delete worker_ctx.scope;
+			worker_ctx.scope = new Scope(*ctx.scope);
+			worker_ctx.depth = ctx.depth;
+			worker_ctx.make_interpret_error(string_format("Parallel foreach failed: %s", e.what()), &loop);
+			fail_task(worker_ctx, task, first_error);
+		}
+	};
+
+	if (serial)
+	{
+		for (std::size_t task = 0; task < tasks.size(); task++)
+		{
+			job(0, task);
+		}
+	}
+	else
+	{
+		ctx.work_pool().run(tasks.size(), job);
+	}
+
+	InternedLock.shared = false;
+	InternedCollections.shared_below = shared_below;
+
+	std::vector<std::tuple<instance_entity, std::uint32_t, instance_entity>> writes;
+	auto last_task = first_error.load();
+	for (std::size_t t = 0; t < tasks.size() && t <= last_task; t++)
+	{
+		auto& task = tasks[t];
+		auto& commands = workers[task.worker].ctx->commands.commands;
+		for (auto i = task.begin; checked && i < task.end; i++)
+		{
+			writes.push_back({ commands[i].entity, commands[i].type.index, workers[task.worker].writers[i] });
+		}
+
+		ecs_defer_commands(ctx.commands, commands.begin() + task.begin, commands.begin() + task.end);
+
+		for (auto& reduction : task.reductions)
+		{
+			if (!ctx.has_errors())
+				apply_reduction(ctx, &loop, reduction);
+		}
+	}
+
+	for (auto& worker : workers)
+	{
+		loop.plan.visited += worker.visited;
+		loop.plan.ran += worker.ran;
+		worker.ctx->ecs = nullptr;
+	}
+	if (loop.explain)
+	{
+		loop.plan.access += serial
+			? string_format(", %zu tasks in row order on this thread", tasks.size())
+			: string_format(", %zu tasks on %zu threads", tasks.size(), workers.size());
+		for (auto handle : in_place)
+		{
+			loop.plan.access += ", " + ecs_get_type(ecs, handle).name + " rewritten in place";
+		}
+	}
+
+	if (last_task < tasks.size())
+	{
+		// the tasks after the failing one may have run all the same, and their commands and sums
+		// were dropped above; so are the rows they rewrote in place, and the world is left as if
+		// the rows had run in order up to the failing one
+		for (auto t = last_task + 1; t < tasks.size(); t++)
+		{
+			ecs_undo_rewrites(ecs, tasks[t].rewritten);
+		}
+
+		ctx.interpret_error = tasks[last_task].error;
+	}
+	else if (checked)
+	{
+		check_races(ctx, writes);
+	}
+}
+
+void ParallelForeach::gather_writes(const std::vector<std::shared_ptr<Statement>>& statements)
+{
+	for (auto& statement : statements)
+	{
+		if (AttachStatement* attach = dynamic_cast<AttachStatement*>(statement.get()))
+		{
+			auto& into = attach->entity_name == loop.entity_name ? block_writes.to_row : block_writes.elsewhere;
+			into.insert(into.end(), attach->handles.begin(), attach->handles.end());
+		}
+		else if (DetachStatement* detach = dynamic_cast<DetachStatement*>(statement.get()))
+		{
+			block_writes.elsewhere.insert(block_writes.elsewhere.end(), detach->handles.begin(), detach->handles.end());
+		}
+		else if (ReduceStatement* reduce = dynamic_cast<ReduceStatement*>(statement.get()))
+		{
+			block_writes.reduced.push_back(reduce->name);
+		}
+		else if (IfStatement* branch = dynamic_cast<IfStatement*>(statement.get()))
+		{
+			gather_writes(branch->then_branch);
+			gather_writes(branch->else_branch);
+		}
+		else if (dynamic_cast<GetStatement*>(statement.get()))
+		{
+			block_writes.gets = true;
+		}
+	}
+}
+
+void ParallelForeach::plan_in_place(Context& ctx)
+{
+	in_place.clear();
+	if (block_writes.gets)
+		return;
+
+	auto& elsewhere = block_writes.elsewhere;
+	for (auto handle : block_writes.to_row)
+	{
+		if (std::find(elsewhere.begin(), elsewhere.end(), handle) != elsewhere.end() || std::find(in_place.begin(), in_place.end(), handle) != in_place.end())
+			continue;
+
+		if (!reduced_into(ctx, handle) && ecs_prepare_concurrent_writes(*ctx.ecs, handle))
+			in_place.push_back(handle);
+	}
+}
+
+bool ParallelForeach::reduced_into(Context& ctx, TypeHandle handle)
+{
+	for (auto& name : block_writes.reduced)
+	{
+		bool row_member = false;
+		for (std::size_t k = 0; k < loop.positive_components.size(); k++)
+		{
+			for (auto& param : loop.positive_components[k].params)
+			{
+				VarExpr* var = dynamic_cast<VarExpr*>(param.get());
+				if (var && var->name == name)
+				{
+					row_member = true;
+					if (loop.positive_handles[k] == handle)
+						return true;
+				}
+			}
+		}
+
+		if (row_member || name == loop.entity_name)
+			continue;
+
+		auto binding = ctx.scope->get_binding(name);
+		if (!binding)
+			return true;
+
+		CompMemberRefExpr* ref = dynamic_cast<CompMemberRefExpr*>(binding.get());
+		if (ref && ref->comp.type_id == ecs_get_type(*ctx.ecs, handle).id)
+			return true;
+	}
+
+	return false;
+}
+
+void ParallelForeach::run_task(std::size_t w, std::size_t t, const ArchetypeQuery& query, const std::vector<instance_entity>* candidates, bool check_where, bool checked, std::atomic<std::size_t>& first_error)
+{
+	auto& worker = workers[w];
+	auto& worker_ctx = *worker.ctx;
+	auto& commands = worker_ctx.commands.commands;
+	auto& task = tasks[t];
+	task.worker = w;
+	task.begin = task.end = commands.size();
+	task.error.reset();
+	task.reductions.clear();
+	task.rewritten.clear();
+	worker_ctx.reductions = &task.reductions;
+	worker_ctx.rewritten = in_place.empty() ? nullptr : &task.rewritten;
+	if (t > first_error.load())
+		return;
+
+	auto& ecs = *worker_ctx.ecs;
+	ArchetypeChunk* chunk = nullptr;
+	std::size_t count = 0;
+
+	if (candidates)
+	{
+		count = std::min(candidates->size() - task.first, ArchetypeChunk::Capacity);
+	}
+	else
+	{
+		auto& archetype = ecs.archetypes[task.archetype];
+		chunk = archetype.chunks[task.first / ArchetypeChunk::Capacity].get();
+		count = std::min(archetype.size - task.first, ArchetypeChunk::Capacity);
+
+		worker.slots.clear();
+		for (auto handle : loop.positive_handles)
 		{
-			ecs_unadorn_instance(*ctx.ecs, entity->r.value, comp);
-			ctx.scope->internal_rec_delete_comp_ref(entity->r.value, ecs_get_type_id(*ctx.ecs, comp));
+			auto& type_def = ecs_get_type(ecs, handle);
+			worker.slots.push_back({ &type_def, archetype.slot_of(type_def.id) });
 		}
 	}
-};
 
-struct QueryEntitiesStatement : public Statement
-{
-	std::string entity_name;
-	std::vector<CompParamCtor> positive_components;
-	std::vector<CompParamCtor> negative_components;
+	for (std::size_t i = 0; i < count; i++)
+	{
+		instance_entity entity;
+		worker.visited++;
+		worker.rows.clear();
 
-	std::vector<std::string> positive_names;
-	std::vector<std::string> negative_names;
-	std::vector<std::shared_ptr<Statement>> block;
+		if (candidates)
+		{
+			entity = (*candidates)[task.first + i];
+			if (!ecs.registry.valid(entity) || !ecs_query_matches(ecs, query, entity))
+				continue;
 
-	QueryEntitiesStatement(Range range, std::string entity_name, std::vector<CompParamCtor> positive, std::vector<CompParamCtor> negative, std::vector<std::shared_ptr<Statement>> block)
-		: Statement(std::get<0>(range), std::get<1>(range))
-		, entity_name(entity_name)
-		, positive_components(positive)
-		, negative_components(negative)
-		, block(block)
-	{
-		for (auto& comp : positive_components)
+			for (auto handle : loop.positive_handles)
+			{
+				auto& type_def = ecs_get_type(ecs, handle);
+				worker.rows.push_back({ &type_def, type_def.row_of(entity) });
+			}
+		}
+		else
 		{
-			positive_names.push_back(comp.comp_name);
+			entity = chunk->entities[i];
+			for (auto [type_def, slot] : worker.slots)
+			{
+				worker.rows.push_back({ type_def, slot == Archetype::NoSlot ? 0 : chunk->rows[slot][i] });
+			}
 		}
 
-		for (auto& comp : negative_components)
+		worker.ran += loop.run_block(worker_ctx, worker.rows, entity, check_where);
+		if (checked)
+			worker.writers.resize(commands.size(), entity);
+
+		if (worker_ctx.has_errors())
 		{
-			negative_names.push_back(comp.comp_name);
+			fail_task(worker_ctx, t, first_error);
+			return;
 		}
 	}
 
-	void execute(Context& ctx) override
-	{
-		if (ctx.has_errors()) return;
+	task.end = commands.size();
+}
 
-		auto& query = ecs_query(*ctx.ecs, positive_names, negative_names);
-		for (auto entity : query)
-		{
-			if (!ctx.ecs->registry.valid(entity)) continue;
+void ParallelForeach::fail_task(Context& worker_ctx, std::size_t t, std::atomic<std::size_t>& first_error)
+{
+	auto& task = tasks[t];
+	task.end = worker_ctx.commands.commands.size();
+	task.error = worker_ctx.interpret_error;
+	worker_ctx.interpret_error.reset();
 
-			ctx.scope->push_scope();
-			ctx.scope->add_binding(entity_name, std::shared_ptr<EntityExpr>(new EntityExpr(entity)));
+	auto current = first_error.load();
+	while (t < current && !first_error.compare_exchange_weak(current, t)) {}
+}
 
-			for (auto& comp_ctor : positive_components)
-			{
-				const auto& comp = ecs_get_component_by_instance(*ctx.ecs, entity, comp_ctor.comp_name);
-				int index = 0;
-				for (auto& var_param : comp_ctor.params)
-				{
-					if (VarExpr* var = dynamic_cast<VarExpr*>(var_param.get()))
-					{
-						auto& name = var->name;
-						auto& value = comp.members[index];
-						
-						std::shared_ptr<Expr> expr_value = nullptr;
-
-						switch (value.kind)
-						{
-						case EComponentMember::Bool:
-							expr_value.reset(new BoolExpr(value.data.b.value));
-							break;
-						case EComponentMember::Int:
-							expr_value.reset(new IntExpr(value.data.i.value));
-							break;
-						case EComponentMember::Float: 
-							expr_value.reset(new FloatExpr(value.data.f.value));
-							break;
-						case EComponentMember::EntityRef:
-							expr_value.reset(new EntityExpr(value.data.e.value));
-							break;
-						case EComponentMember::String:
-							expr_value.reset(new StringExpr(value.data.s.index));
-							break;
-						case EComponentMember::Collection:
-							expr_value.reset(new CollectionExpr(value.data.c.index));
-							break;
-						}
-
-						std::shared_ptr<Expr> ref_expr(new CompMemberRefExpr(name, entity, comp, index, expr_value));
-						ctx.scope->add_binding(name, ref_expr);
-					}
-					else
-					{
-						if (dynamic_cast<VarExpr*>(var_param.get()) != nullptr)
-						{
-							ctx.make_interpret_error(string_format("Expected variable name."), this);
-							return;
-						}
-					}
+void ParallelForeach::check_races(Context& ctx, std::vector<std::tuple<instance_entity, std::uint32_t, instance_entity>>& writes)
+{
+	auto& ecs = *ctx.ecs;
+	std::sort(writes.begin(), writes.end());
 
-					index++;
-				}
+	for (std::size_t first = 0; first < writes.size();)
+	{
+		auto entity = std::get<0>(writes[first]);
+		auto last = first;
+		while (last < writes.size() && std::get<0>(writes[last]) == entity)
+		{
+			last++;
+		}
+
+		// destroys have no type and sort last
+		auto destroy = std::get<1>(writes[last - 1]) == TypeHandle::Invalid ? last - 1 : last;
+		for (auto i = first; i < last; i++)
+		{
+			auto [target, type, writer] = writes[i];
+			if (destroy < last && writer != std::get<2>(writes[destroy]))
+			{
+				ctx.make_interpret_error(string_format("Rows @%u and @%u of a parallel foreach race: one destroys @%u, which the other writes to",
+					entt::to_integral(std::get<2>(writes[destroy])), entt::to_integral(writer), entt::to_integral(target)), &loop);
+				return;
 			}
 
-			ctx.depth++;
-			for (auto statement : block)
+			if (i > first && type != TypeHandle::Invalid && std::get<1>(writes[i - 1]) == type && std::get<2>(writes[i - 1]) != writer)
 			{
-				statement->execute(ctx);
+				ctx.make_interpret_error(string_format("Rows @%u and @%u of a parallel foreach race: both write %s of @%u",
+					entt::to_integral(std::get<2>(writes[i - 1])), entt::to_integral(writer), ecs.type_defs[type]->name.c_str(), entt::to_integral(target)), &loop);
+				return;
 			}
-			ctx.depth--;
-			ctx.scope->pop_scope();
 		}
+
+		first = last;
 	}
-};
+}
 
 const std::string WHITESPACE = " \n\r\t\f\v";
 
@@ -2123,7 +3915,7 @@ std::vector<TokenPos> split(std::string source_code)
 				if (current_token == "=" || current_token == "<" || current_token == ">")
 				{
 					auto back = tokens.back().token;
-					if (back == "<" || back == ">" || back == "=" || back == "!")
+					if (back == "<" || back == ">" || back == "=" || back == "!" || (back == "+" && current_token == "="))
 					{
 						current_token = back + c;
 						tokens.pop_back();
@@ -2168,7 +3960,7 @@ std::deque<Token> tokenize(std::vector<TokenPos> token_pos)
 	static std::unordered_set<std::string> symbols{ 
 		"(", ")", ",", ";", ":", "[", "]", 
 		"_", "@", "+", "-", "*", "/", "{", "}",
-		"<", "<=", "==", "!=", ">=", ">", "\""
+		"<", "<=", "==", "!=", ">=", ">", "+=", "\""
 	};
 
 	bool inside_quotes = false;
@@ -2216,6 +4008,13 @@ std::deque<Token> tokenize(std::vector<TokenPos> token_pos)
 				token.keyword = EKeyword::To;
 			else if (tok == "from")
 				token.keyword = EKeyword::From;
+
+
+
+
+
+
+
 			else if (tok == "if")
 				token.keyword = EKeyword::If;
 			else if (tok == "else")
@@ -2254,6 +4053,8 @@ std::deque<Token> tokenize(std::vector<TokenPos> token_pos)
 				token.type = EToken::Monkey;
 			else if (tok == "+")
 				token.type = EToken::Plus;
+			else if (tok == "+=")
+				token.type = EToken::PlusAssign;
 			else if (tok == "-")
 				token.type = EToken::Minus;
 			else if (tok == "*")
@@ -2376,6 +4177,23 @@ void digest_keyword(std::deque<Token>& tokens, EKeyword keyword)
 	tokens.pop_front();
 }
 
+// some keywords are only reserved where a statement can use them, so scripts may still name things
+// after them; there, a quote spelling `keyword` at the front is turned into it
+bool contextual_keyword(std::deque<Token>& tokens, EKeyword keyword)
+{
+	if (tokens.empty())
+		return false;
+
+	auto& tok = tokens.front();
+	if (tok.type == EToken::Quote && tok.quote == stringify_keyword(keyword))
+	{
+		tok.type = EToken::Keyword;
+		tok.keyword = keyword;
+	}
+
+	return tok.type == EToken::Keyword && tok.keyword == keyword;
+}
+
 void expect(std::deque<Token>& tokens, EToken type)
 {
 	auto& tok = tokens.front();
@@ -2608,13 +4426,14 @@ CompParamCtor parse_comp_params_ctor(std::deque<Token>& tokens)
 	return CompParamCtor{ comp_name, fields };
 }
 
-// "define Position(x: int, y: int);"
+// "define Position(x: int, y: int);", "define Target(who: ref cascade);", "define Name(id: int) index id;",
+// "define Health(hp: int) ordered index hp;"
 std::shared_ptr<Statement> parse_comp_define(std::deque<Token>& tokens)
 {
 	auto start = tokens.front();
 	digest_keyword(tokens, EKeyword::Define);
 	auto comp_name = digest_quote(tokens);
-	std::vector<std::tuple<std::string, EType>> members;
+	std::vector<std::tuple<std::string, EType, ERefPolicy>> members;
 
 	if (tokens.front().type == EToken::OpenParen)
 	{
@@ -2624,23 +4443,122 @@ std::shared_ptr<Statement> parse_comp_define(std::deque<Token>& tokens)
 			auto member_name = digest_quote(tokens);
 			digest(tokens, EToken::Colon);
 			auto type_name = parse_type_name(tokens);
+
+			// refs may say what happens to them when their target is destroyed
+			auto on_destroy = ERefPolicy::Keep;
+			auto tok = tokens.front();
+			if (type_name == EType::Entity && tok.type == EToken::Quote)
+			{
+				if (tok.quote == "cascade")
+					on_destroy = ERefPolicy::Cascade;
+				else if (tok.quote == "nullify")
+					on_destroy = ERefPolicy::Nullify;
+				else
+				{
+					ParseError p;
+					p.text = string_format("Expected cascade or nullify after ref, but found %s instead.", tok.quote.c_str());
+					p.token = tok;
+					generic_parse_error = p;
+					return nullptr;
+				}
+				tokens.pop_front();
+			}
+
 			maybe_digest(tokens, EToken::Comma);
-			members.push_back({ member_name, type_name });
+			members.push_back({ member_name, type_name, on_destroy });
 		}
 		digest(tokens, EToken::ClosedParen);
 	}
+
+	// "index a, b" hashes members, "ordered index hp" keeps them sorted for range lookups
+	std::vector<std::tuple<std::string, EMemberIndex>> indexes;
+	while (tokens.front().type == EToken::Quote)
+	{
+		auto kind = EMemberIndex::Hash;
+		if (tokens.front().quote == "ordered")
+		{
+			kind = EMemberIndex::Ordered;
+			tokens.pop_front();
+		}
+
+		auto tok = tokens.front();
+		if (tok.type != EToken::Quote || tok.quote != "index")
+		{
+			ParseError p;
+			p.text = string_format("Expected index after component definition, but found %s instead.", tok.type == EToken::Quote ? tok.quote.c_str() : stringify_token(tok.type).c_str());
+			p.token = tok;
+			generic_parse_error = p;
+			return nullptr;
+		}
+		tokens.pop_front();
+
+		do
+		{
+			indexes.push_back({ digest_quote(tokens), kind });
+		} while (maybe_digest(tokens, EToken::Comma));
+	}
+
 	auto end = tokens.front();
 	digest(tokens, EToken::Semicolon);
 
-	return std::make_shared<DefineComponentStatement>(std::tuple{ start, end }, comp_name, members);
+	return std::make_shared<DefineComponentStatement>(std::tuple{ start, end }, comp_name, members, indexes);
 }
 
 //"create player-character with Position(x: 10, y: 10), Mass(kg: 1), Player();"
+//"create 1000 enemies with Position(x: 0, y: 0);" or "create 1000 with Position(x: 0, y: 0);"
+//"create g from Goblin;" or "create 10 goblins from Goblin with Mass(kg: 5);"
 std::shared_ptr<Statement> parse_create_entity(std::deque<Token>& tokens)
 {
 	auto start = tokens.front();
 	digest_keyword(tokens, EKeyword::Create);
-	auto entity_name = digest_quote(tokens);
+
+	std::shared_ptr<Expr> count = nullptr;
+	if (tokens.front().type == EToken::Number || tokens.front().type == EToken::OpenParen)
+	{
+		count = parse_expr(tokens);
+	}
+
+	std::string entity_name;
+	if (!count || tokens.front().type == EToken::Quote)
+	{
+		entity_name = digest_quote(tokens);
+	}
+
+	std::string prefab_name;
+	if (tokens.front().keyword == EKeyword::From)
+	{
+		digest_keyword(tokens, EKeyword::From);
+		prefab_name = digest_quote(tokens);
+	}
+	std::vector<CompCtor> comps;
+
+	if (tokens.front().keyword == EKeyword::With)
+	{
+		digest_keyword(tokens, EKeyword::With);
+		while (tokens.front().type != EToken::Semicolon)
+		{
+			comps.push_back(parse_comp_ctor(tokens));
+			maybe_digest(tokens, EToken::Comma);
+		}
+	}
+
+	auto end = tokens.front();
+	digest(tokens, EToken::Semicolon);
+
+	if (count)
+	{
+		return std::make_shared<CreateEntitiesStatement>(std::tuple{ start, end }, count, entity_name, comps, prefab_name);
+	}
+
+	return std::make_shared<CreateEntityStatement>(std::tuple{ start, end }, entity_name, comps, prefab_name);
+}
+
+// "prefab Goblin with Position(x: 0, y: 0), Mass(kg: 3);"
+std::shared_ptr<Statement> parse_prefab(std::deque<Token>& tokens)
+{
+	auto start = tokens.front();
+	digest_keyword(tokens, EKeyword::Prefab);
+	auto prefab_name = digest_quote(tokens);
 	std::vector<CompCtor> comps;
 
 	if (tokens.front().keyword == EKeyword::With)
@@ -2656,7 +4574,7 @@ std::shared_ptr<Statement> parse_create_entity(std::deque<Token>& tokens)
 	auto end = tokens.front();
 	digest(tokens, EToken::Semicolon);
 
-	return std::make_shared<CreateEntityStatement>(std::tuple{ start, end }, entity_name, comps);
+	return std::make_shared<DefinePrefabStatement>(std::tuple{ start, end }, prefab_name, comps);
 }
 
 std::vector<std::shared_ptr<Statement>> parse_block(std::deque<Token>& tokens);
@@ -2687,16 +4605,20 @@ std::shared_ptr<Statement> parse_if(std::deque<Token>& tokens)
 	return std::shared_ptr<Statement>(new IfStatement({ start_tok, end_tok }, expr, then_block, else_block));
 }
 
-//"destroy player-character;"
+//"destroy player-character;" or "destroy e1, e2, e3;"
 std::shared_ptr<Statement> parse_destroy_entity(std::deque<Token>& tokens)
 {
 	auto start = tokens.front();
 	digest_keyword(tokens, EKeyword::Destroy);
-	auto entity_name = digest_quote(tokens);
+	std::vector<std::string> entity_names{ digest_quote(tokens) };
+	while (!generic_parse_error.has_value() && maybe_digest(tokens, EToken::Comma))
+	{
+		entity_names.push_back(digest_quote(tokens));
+	}
 	auto end = tokens.front();
 	digest(tokens, EToken::Semicolon);
 
-	return std::make_shared<DestroyEntityStatement>(std::tuple{ start, end }, entity_name);
+	return std::make_shared<DestroyEntityStatement>(std::tuple{ start, end }, entity_names);
 }
 
 //"get Position(x, y) from e1;"
@@ -2777,62 +4699,257 @@ std::shared_ptr<Statement> parse_system(std::deque<Token>& tokens)
 }
 
 // "foreach player with Position(x, y), Player without Mass { }"
-std::shared_ptr<Statement> parse_foreach(std::deque<Token>& tokens)
+// "foreach player with changed Position(x, y) { }" only visits rows written since the system last ran
+// "first player with Position(x, y) where x > 10 { }" runs the block for the first matching row only
+// "count n with Position(x, y) where x > 10;" and "any b with Player;" bind how many rows match, and whether any does
+std::shared_ptr<Statement> parse_query(std::deque<Token>& tokens)
 {
 	auto start = tokens.front();
-	digest_keyword(tokens, EKeyword::Foreach);
+	auto form = EQueryForm::Each;
+	switch (start.keyword)
+	{
+	case EKeyword::First: form = EQueryForm::First; break;
+	case EKeyword::Count: form = EQueryForm::Count; break;
+	case EKeyword::Any: form = EQueryForm::Any; break;
+	default: break;
+	}
+	auto binds_result = form == EQueryForm::Count || form == EQueryForm::Any;
+
+	digest_keyword(tokens, start.keyword);
 	auto entity_name = digest_quote(tokens);
 	std::vector<CompParamCtor> positive_comps;
 	std::vector<CompParamCtor> negative_comps;
+	std::vector<std::size_t> changed_comps;
+	std::shared_ptr<Expr> referenced;
 
 	auto tok = tokens.front();
 
+	if (contextual_keyword(tokens, EKeyword::Referencing))
+	{
+		digest_keyword(tokens, EKeyword::Referencing);
+		referenced = parse_expr(tokens);
+		tok = tokens.front();
+	}
+
 	if (tok.type == EToken::Keyword && tok.keyword == EKeyword::With)
 	{
 		digest_keyword(tokens, EKeyword::With);
 		while (true)
 		{
+			// "changed" is only the keyword with a component after it, "with changed(x)" names a component
+			if (tokens.size() > 1 && tokens[1].type == EToken::Quote && contextual_keyword(tokens, EKeyword::Changed))
+			{
+				digest_keyword(tokens, EKeyword::Changed);
+				changed_comps.push_back(positive_comps.size());
+			}
+
 			positive_comps.push_back(parse_comp_params_ctor(tokens));
-			maybe_digest(tokens, EToken::Comma);
+			auto separated = maybe_digest(tokens, EToken::Comma);
 
 			tok = tokens.front();
 
-			if (tok.type == EToken::OpenBrace) break;
+			if (tok.type == EToken::OpenBrace || tok.type == EToken::Semicolon) break;
 			if (tok.type == EToken::Keyword && tok.keyword == EKeyword::Without) break;
+			// a component after a comma may be called "where"
+			if (!separated && contextual_keyword(tokens, EKeyword::Where)) break;
 		}
 	}
 
 	if (tok.type == EToken::Keyword && tok.keyword == EKeyword::Without)
 	{
 		digest_keyword(tokens, EKeyword::Without);
-		while (tok.type != EToken::OpenBrace)
+		while (tok.type != EToken::OpenBrace && tok.type != EToken::Semicolon)
 		{
 			negative_comps.push_back(parse_comp_params_ctor(tokens));
-			maybe_digest(tokens, EToken::Comma);
+			auto separated = maybe_digest(tokens, EToken::Comma);
 
 			tok = tokens.front();
+			if (!separated && contextual_keyword(tokens, EKeyword::Where)) break;
 		}
 	}
 
+	std::shared_ptr<Expr> where;
+	if (contextual_keyword(tokens, EKeyword::Where))
+	{
+		digest_keyword(tokens, EKeyword::Where);
+		where = parse_expr(tokens);
+	}
+
+	std::vector<std::shared_ptr<Statement>> block;
+	auto end = tokens.front();
+	if (binds_result)
+	{
+		digest(tokens, EToken::Semicolon);
+	}
+	else
+	{
+		digest(tokens, EToken::OpenBrace);
+		block = parse_block(tokens);
+		end = tokens.front();
+		digest(tokens, EToken::ClosedBrace);
+	}
+
+	auto query = std::make_shared<QueryEntitiesStatement>(Range{ start, end }, entity_name, positive_comps, negative_comps, block, changed_comps, referenced, where);
+	query->form = form;
+	return query;
+}
+
+// "parallel foreach e with Position(x, y) { }" runs the block for the rows on several threads at once
+std::shared_ptr<Statement> parse_parallel(std::deque<Token>& tokens)
+{
+	digest_keyword(tokens, EKeyword::Parallel);
+	if (tokens.front().keyword != EKeyword::Foreach)
+	{
+		ParseError p;
+		p.text = string_format("Expected foreach after parallel");
+		p.token = tokens.front();
+		generic_parse_error = p;
+		return nullptr;
+	}
+
+	auto statement = parse_query(tokens);
+	if (auto query = std::dynamic_pointer_cast<QueryEntitiesStatement>(statement))
+	{
+		query->parallel = true;
+	}
+
+	return statement;
+}
+
+// "explain foreach e with Health(hp) where hp < 10 { ... }" runs the foreach, then prints how it found its rows
+std::shared_ptr<Statement> parse_explain(std::deque<Token>& tokens)
+{
+	digest_keyword(tokens, EKeyword::Explain);
+	for (auto keyword : { EKeyword::Parallel, EKeyword::First, EKeyword::Count, EKeyword::Any })
+	{
+		if (contextual_keyword(tokens, keyword))
+			break;
+	}
+
+	auto keyword = tokens.front().keyword;
+	if (tokens.front().type != EToken::Keyword || (keyword != EKeyword::Foreach && keyword != EKeyword::First && keyword != EKeyword::Count && keyword != EKeyword::Any && keyword != EKeyword::Parallel))
+	{
+		ParseError p;
+		p.text = string_format("Expected foreach, first, count, any or parallel after explain");
+		p.token = tokens.front();
+		generic_parse_error = p;
+		return nullptr;
+	}
+
+	auto statement = keyword == EKeyword::Parallel ? parse_parallel(tokens) : parse_query(tokens);
+	if (auto query = std::dynamic_pointer_cast<QueryEntitiesStatement>(statement))
+	{
+		query->explain = true;
+	}
+
+	return statement;
+}
+
+// "on attach Mass(kg) to e { }", "on update Position(x, y) to e { }", "on detach Foo from e { }"
+std::shared_ptr<Statement> parse_observer(std::deque<Token>& tokens)
+{
+	auto start = tokens.front();
+	digest_keyword(tokens, EKeyword::On);
+
+	auto kind = EObserverEvent::Attach;
+	auto tok = tokens.front();
+	if (tok.type == EToken::Keyword && tok.keyword == EKeyword::Detach)
+	{
+		kind = EObserverEvent::Detach;
+	}
+	else if (contextual_keyword(tokens, EKeyword::Update))
+	{
+		kind = EObserverEvent::Update;
+	}
+	else if (tok.type != EToken::Keyword || tok.keyword != EKeyword::Attach)
+	{
+		ParseError p;
+		p.text = string_format("Expected attach, detach or update after on");
+		p.token = tok;
+		generic_parse_error = p;
+		return nullptr;
+	}
+	tokens.pop_front();
+
+	auto comp = parse_comp_params_ctor(tokens);
+	digest_keyword(tokens, kind == EObserverEvent::Detach ? EKeyword::From : EKeyword::To);
+	auto entity_name = digest_quote(tokens);
+
 	digest(tokens, EToken::OpenBrace);
 	auto block = parse_block(tokens);
 	auto end = tokens.front();
 	digest(tokens, EToken::ClosedBrace);
-	return std::shared_ptr<Statement>(new QueryEntitiesStatement({ start, end }, entity_name, positive_comps, negative_comps, block));
+
+	return std::make_shared<DefineObserverStatement>(std::tuple{ start, end }, kind, comp, entity_name, block);
 }
 
-// "print();"
+// "print();" or "print(memory);"
 std::shared_ptr<Statement> parse_print(std::deque<Token>& tokens)
 {
 	auto start = tokens.front();
 	digest_keyword(tokens, EKeyword::Print);
 	digest(tokens, EToken::OpenParen);
+
+	std::string what;
+	if (tokens.front().type == EToken::Quote)
+	{
+		auto tok = tokens.front();
+		what = digest_quote(tokens);
+
+		if (what != "memory")
+		{
+			ParseError p;
+			p.text = string_format("Unknown print target '%s', expected 'memory'", what.c_str());
+			p.token = tok;
+			generic_parse_error = p;
+		}
+	}
+
 	digest(tokens, EToken::ClosedParen);
 	auto end = tokens.front();
 	digest(tokens, EToken::Semicolon);
+
+	if (what == "memory")
+	{
+		return std::shared_ptr<Statement>(new PrintMemoryStatement({ start, end }));
+	}
+
 	return std::shared_ptr<Statement>(new PrintContextStatement({ start, end }));
 }
 
+// "compact;" or "compact 10000;"
+std::shared_ptr<Statement> parse_compact(std::deque<Token>& tokens)
+{
+	auto start = tokens.front();
+	digest_keyword(tokens, EKeyword::Compact);
+
+	std::shared_ptr<Expr> budget = nullptr;
+	if (tokens.front().type != EToken::Semicolon)
+	{
+		budget = parse_expr(tokens);
+	}
+
+	auto end = tokens.front();
+	digest(tokens, EToken::Semicolon);
+
+	return std::make_shared<CompactStatement>(std::tuple{ start, end }, budget);
+}
+
+// "total += x;"
+std::shared_ptr<Statement> parse_reduce(std::deque<Token>& tokens)
+{
+	auto start = tokens.front();
+	auto name = digest_quote(tokens);
+	digest(tokens, EToken::PlusAssign);
+
+	auto value = parse_expr(tokens);
+
+	auto end = tokens.front();
+	digest(tokens, EToken::Semicolon);
+
+	return std::make_shared<ReduceStatement>(std::tuple{ start, end }, name, value);
+}
+
 std::vector<std::shared_ptr<Statement>> parse(std::string input)
 {
 	std::vector<std::shared_ptr<Statement>> statements;
@@ -2849,6 +4966,21 @@ std::vector<std::shared_ptr<Statement>> parse_block(std::deque<Token>& tokens)
 
 	while (!tokens.empty())
 	{
+		if (tokens.front().type == EToken::Quote && tokens.size() > 1 && tokens[1].type == EToken::PlusAssign)
+		{
+			if (generic_parse_error.has_value()) return statements;
+
+			statements.push_back(parse_reduce(tokens));
+			continue;
+		}
+
+		// these keywords only ever start a statement, so anywhere else they are free to be names
+		for (auto keyword : { EKeyword::On, EKeyword::Prefab, EKeyword::Compact, EKeyword::Explain, EKeyword::Parallel, EKeyword::First, EKeyword::Count, EKeyword::Any })
+		{
+			if (contextual_keyword(tokens, keyword))
+				break;
+		}
+
 		if (tokens.front().type != EToken::Keyword)
 		{
 			if (tokens.front().type == EToken::Quote)
@@ -2873,6 +5005,14 @@ std::vector<std::shared_ptr<Statement>> parse_block(std::deque<Token>& tokens)
 		{
 			statements.push_back(parse_create_entity(tokens));
 		}
+		else if (tok.keyword == EKeyword::Prefab)
+		{
+			statements.push_back(parse_prefab(tokens));
+		}
+		else if (tok.keyword == EKeyword::Compact)
+		{
+			statements.push_back(parse_compact(tokens));
+		}
 		else if (tok.keyword == EKeyword::Destroy)
 		{
 			statements.push_back(parse_destroy_entity(tokens));
@@ -2889,9 +5029,17 @@ std::vector<std::shared_ptr<Statement>> parse_block(std::deque<Token>& tokens)
 		{
 			statements.push_back(parse_get_from_entity(tokens));
 		}
-		else if (tok.keyword == EKeyword::Foreach)
+		else if (tok.keyword == EKeyword::Foreach || tok.keyword == EKeyword::First || tok.keyword == EKeyword::Count || tok.keyword == EKeyword::Any)
+		{
+			statements.push_back(parse_query(tokens));
+		}
+		else if (tok.keyword == EKeyword::Explain)
 		{
-			statements.push_back(parse_foreach(tokens));
+			statements.push_back(parse_explain(tokens));
+		}
+		else if (tok.keyword == EKeyword::Parallel)
+		{
+			statements.push_back(parse_parallel(tokens));
 		}
 		else if (tok.keyword == EKeyword::Print)
 		{
@@ -2901,6 +5049,10 @@ std::vector<std::shared_ptr<Statement>> parse_block(std::deque<Token>& tokens)
 		{
 			statements.push_back(parse_system(tokens));
 		}
+		else if (tok.keyword == EKeyword::On)
+		{
+			statements.push_back(parse_observer(tokens));
+		}
 		else if (tok.keyword == EKeyword::If)
 		{
 			statements.push_back(parse_if(tokens));
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+	a fixed set of threads running batches of numbered tasks. each worker owns a queue, takes its own
+	tasks from the front in order and, once it runs dry, steals from the back of the others', so a few
+	expensive tasks even out without everyone contending on one shared queue.
+
+	the thread calling `run` works as worker 0 and returns when every task of the batch is done. a task
+	that throws does not stop the others; `run` rethrows the exception of the lowest such task once
+	the batch is done, and the pool is ready for the next one
+*/
+
+struct WorkPool
+{
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<std::size_t> tasks;
+	};
+
+	std::vector<std::thread> threads;
+	std::vector<std::unique_ptr<Queue>> queues;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+
+	std::function<void(std::size_t worker, std::size_t task)> job;
+	std::size_t batch = 0;
+	std::size_t remaining = 0;
+	std::size_t working = 0;
+	bool stopping = false;
+
+	// the exception of the lowest task that threw in the current batch
+	std::exception_ptr error;
+	std::size_t error_task = 0;
+
+	explicit WorkPool(std::size_t workers)
+	{
+		workers = std::max<std::size_t>(workers, 1);
+		for (std::size_t worker = 0; worker < workers; worker++)
+		{
+			queues.push_back(std::make_unique<Queue>());
+		}
+
+		for (std::size_t worker = 1; worker < workers; worker++)
+		{
+			threads.emplace_back([this, worker]() { loop(worker); });
+		}
+	}
+
+	WorkPool(const WorkPool&) = delete;
+	WorkPool& operator=(const WorkPool&) = delete;
+
+	~WorkPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+	}
+
+	std::size_t size() const
+	{
+		return queues.size();
+	}
+
+	// runs job(worker, task) for every task below `tasks`; worker w starts on the w-th contiguous
+	// share of them, so neighbouring tasks tend to run on the same thread
+	void run(std::size_t tasks, std::function<void(std::size_t worker, std::size_t task)> batch_job)
+	{
+		if (tasks == 0)
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job = std::move(batch_job);
+			remaining = tasks;
+
+			for (std::size_t worker = 0; worker < queues.size(); worker++)
+			{
+				std::lock_guard<std::mutex> queue_lock(queues[worker]->mutex);
+				for (auto task = tasks * worker / queues.size(); task < tasks * (worker + 1) / queues.size(); task++)
+				{
+					queues[worker]->tasks.push_back(task);
+				}
+			}
+
+			batch++;
+			working++;
+		}
+		wake.notify_all();
+
+		work(0);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		working--;
+		done.wait(lock, [this]() { return remaining == 0 && working == 0; });
+		job = nullptr;
+
+		auto thrown = error;
+		error = nullptr;
+		lock.unlock();
+
+		if (thrown)
+			std::rethrow_exception(thrown);
+	}
+
+	void loop(std::size_t worker)
+	{
+		std::size_t seen = 0;
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&]() { return stopping || batch != seen; });
+				if (stopping)
+					return;
+
+				seen = batch;
+				working++;
+			}
+
+			work(worker);
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				working--;
+			}
+			done.notify_all();
+		}
+	}
+
+	// the counters go down whether or not the job throws, or `run` would wait for it forever
+	void work(std::size_t worker)
+	{
+		std::size_t task;
+		while (take(worker, task))
+		{
+			std::exception_ptr thrown;
+			try
+			{
+				job(worker, task);
+			}
+			catch (...)
+			{
+				thrown = std::current_exception();
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (thrown && (!error || task < error_task))
+			{
+				error = thrown;
+				error_task = task;
+			}
+			remaining--;
+		}
+	}
+
+	bool take(std::size_t worker, std::size_t& task)
+	{
+		{
+			auto& own = *queues[worker];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (!own.tasks.empty())
+			{
+				task = own.tasks.front();
+				own.tasks.pop_front();
+				return true;
+			}
+		}
+
+		for (std::size_t k = 1; k < queues.size(); k++)
+		{
+			auto& other = *queues[(worker + k) % queues.size()];
+			std::lock_guard<std::mutex> lock(other.mutex);
+			if (!other.tasks.empty())
+			{
+				task = other.tasks.back();
+				other.tasks.pop_back();
+				return true;
+			}
+		}
+
+		return false;
+	}
+};
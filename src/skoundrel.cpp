@@ -1,15 +1,168 @@
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <string>
 
 #include <entt/entt.hpp>
 
 #include "ecs.h"
 #include "parse.h"
- 
+#include "snapshot.h"
+#include "journal.h"
+
+/*
+	skoundrel [options] [script]
+
+	runs `script`, test-coll.ska if neither a script nor a snapshot is given, then ticks its systems
+
+	--load <file>	starts from a world snapshot rather than an empty world
+	--replay <file>	then reapplies a journal recorded on top of that snapshot
+	--save <file>	saves a snapshot of the world once the script has run, before the first tick
+	--record <file>	journals every change the ticks make, to replay onto the snapshot just saved
+	--ticks <n>		how many times the systems tick, once by default
+	--check			then loads the snapshot into a new world, replays the journal onto it and fails
+					unless it ends up like the world the ticks left; without --save and --record it
+					uses skoundrel-check.snap and skoundrel-check.jrnl, removed afterwards
+
+	so `--save base.snap --record changes.jrnl` followed by `--load base.snap --replay changes.jrnl`
+	gets back to where the first run left off. the exit code is non-zero on any error
+*/
+
+struct Options
+{
+	std::string script;
+	std::string load;
+	std::string replay;
+	std::string save;
+	std::string record;
+	int ticks = 1;
+	bool check = false;
+	// the files --check made up for itself, which it removes again
+	bool check_files = false;
+};
+
+bool parse_options(int argc, char* argv[], Options& options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		auto arg = argv[i];
+		if (arg[0] != '-')
+		{
+			options.script = arg;
+			continue;
+		}
+
+		if (std::strcmp(arg, "--check") == 0)
+		{
+			options.check = true;
+			continue;
+		}
+
+		if (i + 1 >= argc)
+		{
+			printf("Missing value for %s\n", arg);
+			return false;
+		}
+
+		auto value = argv[++i];
+		if (std::strcmp(arg, "--load") == 0)
+			options.load = value;
+		else if (std::strcmp(arg, "--replay") == 0)
+			options.replay = value;
+		else if (std::strcmp(arg, "--save") == 0)
+			options.save = value;
+		else if (std::strcmp(arg, "--record") == 0)
+			options.record = value;
+		else if (std::strcmp(arg, "--ticks") == 0)
+			options.ticks = std::atoi(value);
+		else
+		{
+			printf("Unknown option %s\n", arg);
+			return false;
+		}
+	}
+
+	if (options.check && options.save.empty() && options.record.empty())
+	{
+		options.save = "skoundrel-check.snap";
+		options.record = "skoundrel-check.jrnl";
+		options.check_files = true;
+	}
+
+	if (options.check && (options.save.empty() || options.record.empty()))
+	{
+		printf("--check needs both --save and --record, or neither\n");
+		return false;
+	}
+
+	// a journal is only any use on top of the world it started from
+	if (!options.record.empty() && options.save.empty())
+	{
+		printf("--record needs --save, for the snapshot the journal replays onto\n");
+		return false;
+	}
+
+	if (options.script.empty() && options.load.empty() && options.replay.empty())
+		options.script = "test-coll.ska";
+
+	return true;
+}
+
+// loads the snapshot saved before the ticks into a new world and replays their journal onto it, which
+// has to leave it as the ticks left `ctx`
+bool check_round_trip(Context& ctx, const Options& options)
+{
+	Context replayed;
+	SnapshotRemap remap;
+	if (!ecs_load_snapshot(*replayed.ecs, options.save, &remap))
+	{
+		printf("Check failed: could not load snapshot %s\n", options.save.c_str());
+		return false;
+	}
+
+	JournalReplay replay(remap);
+	if (!ecs_replay_journal(*replayed.ecs, options.record, replay))
+	{
+		printf("Check failed: could not replay journal %s\n", options.record.c_str());
+		return false;
+	}
+
+	std::string difference;
+	if (!ecs_replay_matches(*ctx.ecs, *replayed.ecs, replay, difference))
+	{
+		printf("Check failed: %s\n", difference.c_str());
+		return false;
+	}
+
+	printf("Check passed\n");
+	return true;
+}
+
 int main(int argc, char* argv[])
 {
+	Options options;
+	if (!parse_options(argc, argv, options))
+		return 1;
+
 	Context ctx;
 
+	// a snapshot holds the world but not a script's systems or names; a script run after it adds those
+	SnapshotRemap remap;
+	if (!options.load.empty() && !ecs_load_snapshot(*ctx.ecs, options.load, &remap))
+	{
+		printf("Could not load snapshot %s\n", options.load.c_str());
+		return 1;
+	}
+
+	JournalReplay replay(remap);
+	if (!options.replay.empty() && !ecs_replay_journal(*ctx.ecs, options.replay, replay))
+	{
+		printf("Could not replay journal %s\n", options.replay.c_str());
+		return 1;
+	}
+
 	/*
 		parse and interpret:
 
@@ -34,10 +187,65 @@ int main(int argc, char* argv[])
 		>	print();
 	*/
 
-	parse_file(ctx, "test-coll.ska");
+	if (!options.script.empty())
+	{
+		if (!std::ifstream(options.script).is_open())
+		{
+			printf("Could not open script %s\n", options.script.c_str());
+			return 1;
+		}
+
+		// parse_file has already reported the error
+		parse_file(ctx, options.script);
+		if (ctx.has_errors())
+			return 1;
+	}
+
+	if (!options.save.empty() && !ecs_save_snapshot(*ctx.ecs, options.save))
+	{
+		printf("Could not save snapshot %s\n", options.save.c_str());
+		return 1;
+	}
+
+	// a new journal for the new snapshot, replacing any older one
+	BinaryJournal journal;
+	if (!options.record.empty())
+	{
+		if (!journal.open(options.record))
+		{
+			printf("Could not open journal %s\n", options.record.c_str());
+			return 1;
+		}
+
+		ecs_set_journal(*ctx.ecs, &journal);
+	}
 
 	// systems tick via `update`:
-	ctx.update();
+	for (int tick = 0; tick < options.ticks; tick++)
+	{
+		ctx.update();
+		if (ctx.has_errors())
+		{
+			ctx.die_with_error();
+			return 1;
+		}
+	}
+
+	ecs_set_journal(*ctx.ecs, nullptr);
+	journal.close();
+
+	if (options.check)
+	{
+		auto passed = check_round_trip(ctx, options);
+		if (options.check_files)
+		{
+			std::remove(options.save.c_str());
+			std::remove(options.record.c_str());
+		}
+
+		if (!passed)
+			return 1;
+	}
 
 	return 0;
 }
@@ -0,0 +1,756 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "ecs.h"
+#include "parse.h"
+
+/*
+	world snapshot, host byte order, every section starts 8-byte aligned:
+
+	header       magic, version, layout check
+	strings      count, then (index, text) per interned string
+	collections  count, then (index, name, element count, raw TypedValues) per live collection
+	types        count, then (name, member count, (name, kind) per member) per type, in handle order
+	archetypes   count, then (type count, type indices, instance count, entity ids) per non-empty archetype
+	rows         per type: row count, entity ids, then every member column as its raw packed bytes
+
+	columns are written exactly as they sit in memory, so loading one is a single copy out of the mapping;
+	the only fix-up is remapping entity ids, interned string and collection indices to the loading world
+*/
+
+static inline constexpr const char SnapshotMagic[8] = { 'S', 'K', 'N', 'D', 'R', 'L', 'S', 'N' };
+static inline constexpr const std::uint32_t SnapshotVersion = 3;
+
+std::uint32_t snapshot_layout_check()
+{
+	return (std::uint32_t)(sizeof(TypedValue) | (sizeof(std::size_t) << 8) | (sizeof(entt::entity) << 16));
+}
+
+struct SnapshotWriter
+{
+	std::vector<std::uint8_t> bytes;
+
+	void put_bytes(const void* data, std::size_t size)
+	{
+		auto from = (const std::uint8_t*)data;
+		bytes.insert(bytes.end(), from, from + size);
+	}
+
+	template<typename T>
+	void put(T value)
+	{
+		put_bytes(&value, sizeof(T));
+	}
+
+	void put_string(const std::string& str)
+	{
+		put((std::uint32_t)str.size());
+		put_bytes(str.data(), str.size());
+	}
+
+	void put_entity(entt::entity entity)
+	{
+		put((std::uint32_t)entt::to_integral(entity));
+	}
+
+	void align()
+	{
+		bytes.resize((bytes.size() + 7) & ~std::size_t(7), 0);
+	}
+};
+
+struct SnapshotReader
+{
+	const std::uint8_t* data;
+	std::size_t size;
+	std::size_t offset = 0;
+	bool ok = true;
+
+	// a view into the mapping; null (and !ok) if the snapshot is truncated
+	const std::uint8_t* get_bytes(std::size_t count)
+	{
+		if (!ok || count > size - offset)
+		{
+			ok = false;
+			return nullptr;
+		}
+
+		auto at = data + offset;
+		offset += count;
+		return at;
+	}
+
+	const std::uint8_t* get_array(std::size_t count, std::size_t stride)
+	{
+		if (!ok || (stride > 0 && count > (size - offset) / stride))
+		{
+			ok = false;
+			return nullptr;
+		}
+
+		return get_bytes(count * stride);
+	}
+
+	template<typename T>
+	T get()
+	{
+		T value{};
+		if (auto at = get_bytes(sizeof(T)))
+		{
+			std::memcpy(&value, at, sizeof(T));
+		}
+
+		return value;
+	}
+
+	std::string get_string()
+	{
+		auto length = get<std::uint32_t>();
+		auto at = get_bytes(length);
+		return at ? std::string((const char*)at, length) : std::string{};
+	}
+
+	void align()
+	{
+		auto aligned = (offset + 7) & ~std::size_t(7);
+		if (aligned > size)
+		{
+			ok = false;
+			return;
+		}
+
+		offset = aligned;
+	}
+};
+
+// read-only view of a whole file, mapped rather than read where the platform allows it
+struct MappedFile
+{
+	const std::uint8_t* data = nullptr;
+	std::size_t size = 0;
+
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#else
+	int fd = -1;
+#endif
+
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const std::string& path)
+	{
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER file_size;
+		if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+			return false;
+
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!mapping)
+			return false;
+
+		data = (const std::uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		size = (std::size_t)file_size.QuadPart;
+#else
+		fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+
+		struct stat file_stat;
+		if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0)
+			return false;
+
+		void* mapped = mmap(nullptr, (std::size_t)file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapped == MAP_FAILED)
+			return false;
+
+		data = (const std::uint8_t*)mapped;
+		size = (std::size_t)file_stat.st_size;
+#endif
+		return data != nullptr;
+	}
+
+	~MappedFile()
+	{
+#ifdef _WIN32
+		if (data) UnmapViewOfFile(data);
+		if (mapping) CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+		if (data) munmap((void*)data, size);
+		if (fd >= 0) ::close(fd);
+#endif
+	}
+};
+
+/* types */
+
+void snapshot_write_type(SnapshotWriter& out, const ComponentType& type_def)
+{
+	out.put_string(type_def.name);
+	out.put((std::uint32_t)type_def.members.size());
+	for (auto& member : type_def.members)
+	{
+		out.put_string(member.name);
+		out.put((std::uint32_t)member.kind);
+		out.put((std::uint8_t)member.on_destroy);
+		out.put((std::uint8_t)member.index);
+	}
+}
+
+// a type definition as stored, before the world has it
+struct StoredType
+{
+	std::string name;
+	std::vector<ComponentMemberDefinition> members;
+};
+
+// reads a type definition without touching the world; false if it is malformed or conflicts
+// with an existing type of that name
+bool snapshot_check_type(ECS& ecs, SnapshotReader& in, StoredType& stored)
+{
+	auto name = in.get_string();
+	std::vector<ComponentMemberDefinition> members;
+	auto member_count = in.get<std::uint32_t>();
+	for (std::uint32_t m = 0; m < member_count && in.ok; m++)
+	{
+		auto member_name = in.get_string();
+		auto kind = in.get<std::uint32_t>();
+		auto on_destroy = in.get<std::uint8_t>();
+		auto index = in.get<std::uint8_t>();
+		if (kind == 0 || kind >= (std::uint32_t)EComponentMember::Count || on_destroy > (std::uint8_t)ERefPolicy::Cascade)
+			return false;
+
+		if (index > (std::uint8_t)EMemberIndex::Ordered)
+			return false;
+
+		if (index == (std::uint8_t)EMemberIndex::Ordered && kind != (std::uint32_t)EComponentMember::Int && kind != (std::uint32_t)EComponentMember::Float)
+			return false;
+
+		members.push_back(ComponentMemberDefinition{ member_name, (EComponentMember)kind, (ERefPolicy)on_destroy, (EMemberIndex)index });
+	}
+
+	if (!in.ok || members.size() >= ComponentType::MaxMembers)
+		return false;
+
+	auto handle = ecs_get_type_handle(ecs, name);
+	if (handle.is_valid())
+	{
+		auto& type_def = ecs_get_type(ecs, handle);
+		if (type_def.members.size() != members.size())
+			return false;
+
+		for (std::size_t m = 0; m < members.size(); m++)
+		{
+			auto& member = type_def.members[m];
+			if (member.name != members[m].name || member.kind != members[m].kind || member.on_destroy != members[m].on_destroy || member.index != members[m].index)
+				return false;
+		}
+	}
+
+	stored.name = std::move(name);
+	stored.members = std::move(members);
+	return true;
+}
+
+// the world's type for a checked definition, defining it if needed
+ComponentType* snapshot_define_type(ECS& ecs, const StoredType& stored)
+{
+	auto handle = ecs_get_type_handle(ecs, stored.name);
+	if (!handle.is_valid())
+	{
+		ecs_create_type(ecs, stored.name, stored.members);
+		handle = ecs_get_type_handle(ecs, stored.name);
+	}
+
+	return &ecs_get_type(ecs, handle);
+}
+
+// reads a type definition and returns the world's matching type, defining it if needed;
+// null if the stored definition is malformed or conflicts with an existing type of that name
+ComponentType* snapshot_read_type(ECS& ecs, SnapshotReader& in)
+{
+	StoredType stored;
+	if (!snapshot_check_type(ecs, in, stored))
+		return nullptr;
+
+	return snapshot_define_type(ecs, stored);
+}
+
+/* save */
+
+bool ecs_save_snapshot(ECS& ecs, const std::string& path)
+{
+	SnapshotWriter out;
+
+	out.put_bytes(SnapshotMagic, sizeof(SnapshotMagic));
+	out.put(SnapshotVersion);
+	out.put(snapshot_layout_check());
+
+	out.put((std::uint64_t)InternedStrings.interned_strings_index.size());
+	for (auto& [index, text] : InternedStrings.interned_strings_index)
+	{
+		out.put((std::uint64_t)index);
+		out.put_string(text);
+	}
+	out.align();
+
+	auto& collections = InternedCollections.interned_collection_values;
+	std::vector<bool> freed(collections.size(), false);
+	for (auto index : InternedCollections.freed_indices)
+	{
+		freed[index] = true;
+	}
+
+	out.put((std::uint64_t)(collections.size() - InternedCollections.freed_indices.size()));
+	for (std::size_t index = 0; index < collections.size(); index++)
+	{
+		if (freed[index])
+			continue;
+
+		auto name = InternedCollections.interned_collection_reindex.find(index);
+		out.put((std::uint64_t)index);
+		out.put_string(name != InternedCollections.interned_collection_reindex.end() ? name->second : std::string{});
+		out.put((std::uint64_t)collections[index].size());
+		out.align();
+		out.put_bytes(collections[index].data(), collections[index].size() * sizeof(TypedValue));
+	}
+	out.align();
+
+	out.put((std::uint32_t)ecs.type_defs.size());
+	for (auto type_def : ecs.type_defs)
+	{
+		snapshot_write_type(out, *type_def);
+	}
+	out.align();
+
+	std::uint32_t archetype_count = 0;
+	for (auto& archetype : ecs.archetypes)
+	{
+		archetype_count += archetype.size > 0 ? 1 : 0;
+	}
+
+	out.put(archetype_count);
+	for (auto& archetype : ecs.archetypes)
+	{
+		if (archetype.size == 0)
+			continue;
+
+		out.put((std::uint32_t)archetype.types.size());
+		for (auto type_def : archetype.type_defs)
+		{
+			out.put(type_def->handle.index);
+		}
+
+		out.put((std::uint64_t)archetype.size);
+		for (std::size_t position = 0; position < archetype.size; position++)
+		{
+			out.put_entity(archetype.chunks[position / ArchetypeChunk::Capacity]->entities[position % ArchetypeChunk::Capacity]);
+		}
+		out.align();
+	}
+
+	for (auto type_def : ecs.type_defs)
+	{
+		auto rows = type_def->adorned_entities.size();
+		out.put((std::uint64_t)rows);
+		for (std::size_t row = 0; row < rows; row++)
+		{
+			out.put_entity(type_def->adorned_entities.at(row));
+		}
+		out.align();
+
+		for (auto& column : type_def->columns)
+		{
+			column.for_each_span([&](const std::uint8_t* data, std::size_t span)
+			{
+				out.put_bytes(data, span * column.stride);
+			});
+			out.align();
+		}
+	}
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+		return false;
+
+	file.write((const char*)out.bytes.data(), out.bytes.size());
+	return file.good();
+}
+
+/* load */
+
+// maps ids stored in a snapshot to the ids they were given in the loading world
+struct SnapshotRemap
+{
+	static inline constexpr const std::size_t Missing = ~std::size_t(0);
+	static inline constexpr const std::uint32_t NoEntity = ~std::uint32_t(0);
+
+	std::vector<std::uint32_t> old_entities;
+	std::vector<entt::entity> new_entities;
+	std::unordered_map<std::size_t, std::size_t> strings;
+	std::unordered_map<std::size_t, std::size_t> collections;
+
+	// refs to instances that were not alive when the snapshot was taken become null
+	entt::entity entity(std::uint32_t old) const
+	{
+		auto index = entt::to_entity((entt::entity)old);
+		if (index < old_entities.size() && old_entities[index] == old)
+			return new_entities[index];
+
+		return entt::null;
+	}
+
+	static std::size_t lookup(const std::unordered_map<std::size_t, std::size_t>& table, std::size_t old)
+	{
+		auto found = table.find(old);
+		return found != table.end() ? found->second : Missing;
+	}
+
+	void fix_up(TypedValue& value) const
+	{
+		switch (value.type)
+		{
+		case EType::Entity: value.data.entity_value = entity((std::uint32_t)entt::to_integral(value.data.entity_value)); break;
+		case EType::String: value.data.intern_string_index = lookup(strings, value.data.intern_string_index); break;
+		case EType::Collection: value.data.intern_collection_index = lookup(collections, value.data.intern_collection_index); break;
+		default: break;
+		}
+	}
+
+	void fix_up(ComponentColumn& column, std::size_t first_row) const
+	{
+		for (std::size_t row = first_row; row < column.size(); row++)
+		{
+			auto value = column.read(row);
+			switch (column.kind)
+			{
+			case EComponentMember::EntityRef: value.data.e.value = entity((std::uint32_t)entt::to_integral(value.data.e.value)); break;
+			case EComponentMember::String: value.data.s.index = lookup(strings, value.data.s.index); break;
+			case EComponentMember::Collection: value.data.c.index = lookup(collections, value.data.c.index); break;
+			default: return;
+			}
+
+			column.write(row, value);
+		}
+	}
+};
+
+// merges a snapshot into the world: types already defined with the same members are reused, every
+// stored instance becomes a new instance. returns false on a missing, foreign or malformed file, and
+// then leaves the world as it was: the whole file is read and checked before anything is added.
+// `remap_out` receives the stored-to-loaded id mapping, which a journal replay continues from
+bool ecs_load_snapshot(ECS& ecs, const std::string& path, SnapshotRemap* remap_out = nullptr)
+{
+	// it may define types, which no world may do while it has forks
+	if (ecs_has_forks(ecs))
+		return false;
+
+	MappedFile file;
+	if (!file.open(path))
+		return false;
+
+	SnapshotReader in{ file.data, file.size };
+	auto magic = in.get_bytes(sizeof(SnapshotMagic));
+	if (!magic || std::memcmp(magic, SnapshotMagic, sizeof(SnapshotMagic)) != 0)
+		return false;
+
+	if (in.get<std::uint32_t>() != SnapshotVersion || in.get<std::uint32_t>() != snapshot_layout_check())
+		return false;
+
+	/* check: nothing below touches the world until the whole file has been read */
+
+	std::vector<std::pair<std::size_t, std::string>> strings;
+	auto string_count = in.get<std::uint64_t>();
+	for (std::uint64_t s = 0; s < string_count && in.ok; s++)
+	{
+		auto old = (std::size_t)in.get<std::uint64_t>();
+		strings.push_back({ old, in.get_string() });
+	}
+	in.align();
+
+	struct StoredCollection
+	{
+		std::size_t old;
+		std::string name;
+		const std::uint8_t* values;
+		std::size_t count;
+	};
+
+	std::vector<StoredCollection> collections;
+	auto collection_count = in.get<std::uint64_t>();
+	for (std::uint64_t c = 0; c < collection_count && in.ok; c++)
+	{
+		StoredCollection collection;
+		collection.old = (std::size_t)in.get<std::uint64_t>();
+		collection.name = in.get_string();
+		collection.count = (std::size_t)in.get<std::uint64_t>();
+		in.align();
+		collection.values = in.get_array(collection.count, sizeof(TypedValue));
+		collections.push_back(std::move(collection));
+	}
+	in.align();
+
+	std::vector<StoredType> types;
+	std::unordered_map<std::string, std::size_t> type_names;
+	auto type_count = in.get<std::uint32_t>();
+	for (std::uint32_t t = 0; t < type_count && in.ok; t++)
+	{
+		StoredType stored;
+		if (!snapshot_check_type(ecs, in, stored) || !type_names.insert({ stored.name, t }).second)
+			return false;
+
+		types.push_back(std::move(stored));
+	}
+	in.align();
+
+	// every instance lives in exactly one archetype, so the archetype lists double as the instance list
+	struct StoredArchetype
+	{
+		// indices into `types`, sorted
+		std::vector<std::uint32_t> types;
+		const std::uint8_t* entities;
+		std::size_t count;
+		// the loading world's archetype for `types`
+		std::size_t index;
+	};
+
+	SnapshotRemap remap;
+	std::vector<StoredArchetype> archetypes;
+	std::vector<std::size_t> instance_of;
+	std::vector<std::size_t> archetype_of;
+	auto archetype_count = in.get<std::uint32_t>();
+	for (std::uint32_t a = 0; a < archetype_count && in.ok; a++)
+	{
+		StoredArchetype archetype;
+		auto count = in.get<std::uint32_t>();
+		for (std::uint32_t t = 0; t < count && in.ok; t++)
+		{
+			auto type = in.get<std::uint32_t>();
+			if (type >= types.size())
+				return false;
+
+			archetype.types.push_back(type);
+		}
+
+		std::sort(archetype.types.begin(), archetype.types.end());
+		if (std::adjacent_find(archetype.types.begin(), archetype.types.end()) != archetype.types.end())
+			return false;
+
+		archetype.count = (std::size_t)in.get<std::uint64_t>();
+		archetype.entities = in.get_array(archetype.count, sizeof(std::uint32_t));
+		in.align();
+		if (!in.ok)
+			return false;
+
+		for (std::size_t i = 0; i < archetype.count; i++)
+		{
+			std::uint32_t old;
+			std::memcpy(&old, archetype.entities + i * sizeof(std::uint32_t), sizeof(old));
+
+			auto index = entt::to_entity((entt::entity)old);
+			if (index >= remap.old_entities.size())
+			{
+				remap.old_entities.resize(index + 1, SnapshotRemap::NoEntity);
+				instance_of.resize(index + 1);
+			}
+
+			if (remap.old_entities[index] != SnapshotRemap::NoEntity)
+				return false;
+
+			remap.old_entities[index] = old;
+			instance_of[index] = archetype_of.size();
+			archetype_of.push_back(archetypes.size());
+		}
+
+		archetypes.push_back(std::move(archetype));
+	}
+
+	// rows are checked against their instance's archetype: each one belongs to a type of it, at
+	// most once, and so an instance with as many rows as its archetype has types has all of them
+	struct StoredRows
+	{
+		std::size_t count;
+		const std::uint8_t* ids;
+		std::vector<const std::uint8_t*> columns;
+	};
+
+	std::vector<StoredRows> rows(types.size());
+	std::vector<std::uint32_t> rows_of(archetype_of.size(), 0);
+	std::vector<std::uint32_t> last_type(archetype_of.size(), ~std::uint32_t(0));
+	for (std::uint32_t t = 0; t < types.size() && in.ok; t++)
+	{
+		auto& stored = rows[t];
+		stored.count = (std::size_t)in.get<std::uint64_t>();
+		stored.ids = in.get_array(stored.count, sizeof(std::uint32_t));
+		in.align();
+		if (!in.ok)
+			return false;
+
+		for (std::size_t row = 0; row < stored.count; row++)
+		{
+			std::uint32_t old;
+			std::memcpy(&old, stored.ids + row * sizeof(std::uint32_t), sizeof(old));
+
+			auto index = entt::to_entity((entt::entity)old);
+			if (index >= remap.old_entities.size() || remap.old_entities[index] != old)
+				return false;
+
+			auto instance = instance_of[index];
+			auto& archetype_types = archetypes[archetype_of[instance]].types;
+			if (last_type[instance] == t || !std::binary_search(archetype_types.begin(), archetype_types.end(), t))
+				return false;
+
+			last_type[instance] = t;
+			rows_of[instance]++;
+		}
+
+		for (auto& member : types[t].members)
+		{
+			stored.columns.push_back(in.get_array(stored.count, ecs_member_width(member.kind)));
+			in.align();
+		}
+	}
+
+	if (!in.ok)
+		return false;
+
+	for (std::size_t instance = 0; instance < archetype_of.size(); instance++)
+	{
+		if (rows_of[instance] != archetypes[archetype_of[instance]].types.size())
+			return false;
+	}
+
+	/* apply: the file is sound, so from here on nothing fails */
+
+	for (auto& [old, text] : strings)
+	{
+		remap.strings[old] = InternedStrings.add(text);
+	}
+
+	// collections can hold each other and instances, so elements are fixed up once everything exists
+	std::vector<std::size_t> collection_indices;
+	for (auto& collection : collections)
+	{
+		auto index = InternedCollections.create_collection();
+		if (!collection.name.empty())
+		{
+			InternedCollections.assign_collection_name(index, collection.name);
+		}
+
+		remap.collections[collection.old] = index;
+		collection_indices.push_back(index);
+	}
+
+	std::vector<ComponentType*> type_defs;
+	for (auto& stored : types)
+	{
+		type_defs.push_back(snapshot_define_type(ecs, stored));
+	}
+
+	std::vector<instance_entity> created(archetype_of.size());
+	ecs.registry.create(created.begin(), created.end());
+
+	remap.new_entities.resize(remap.old_entities.size(), entt::null);
+	for (std::size_t index = 0; index < remap.old_entities.size(); index++)
+	{
+		if (remap.old_entities[index] != SnapshotRemap::NoEntity)
+			remap.new_entities[index] = created[instance_of[index]];
+	}
+
+	std::size_t next = 0;
+	for (auto& archetype : archetypes)
+	{
+		std::vector<type_entity> archetype_types;
+		for (auto type : archetype.types)
+		{
+			archetype_types.push_back(type_defs[type]->id);
+		}
+
+		archetype.index = ecs_get_archetype(ecs, archetype_types);
+		for (std::size_t i = 0; i < archetype.count; i++, next++)
+		{
+			ecs.registry.get_for_write(created[next]).archetype = archetype.index;
+		}
+	}
+
+	for (std::size_t c = 0; c < collections.size(); c++)
+	{
+		auto& collection = InternedCollections.interned_collection_values[collection_indices[c]];
+		collection.resize(collections[c].count);
+		if (collections[c].count > 0)
+		{
+			std::memcpy(collection.data(), collections[c].values, collections[c].count * sizeof(TypedValue));
+		}
+
+		for (auto& value : collection)
+		{
+			remap.fix_up(value);
+		}
+	}
+
+	for (std::size_t t = 0; t < types.size(); t++)
+	{
+		auto type_def = type_defs[t];
+		auto& stored = rows[t];
+
+		auto first_row = type_def->adorned_entities.size();
+		type_def->adorned_entities.reserve(first_row + stored.count);
+		for (std::size_t row = 0; row < stored.count; row++)
+		{
+			std::uint32_t old;
+			std::memcpy(&old, stored.ids + row * sizeof(std::uint32_t), sizeof(old));
+			type_def->adorned_entities.emplace(remap.entity(old));
+		}
+		type_def->touch_new_rows();
+
+		for (std::size_t m = 0; m < type_def->columns.size(); m++)
+		{
+			auto& column = type_def->columns[m];
+			column.append(stored.columns[m], stored.count);
+			remap.fix_up(column, first_row);
+		}
+		type_def->index_new_rows(first_row);
+	}
+
+	next = 0;
+	for (auto& archetype : archetypes)
+	{
+		for (std::size_t i = 0; i < archetype.count; i++, next++)
+		{
+			ecs_archetype_push(ecs, archetype.index, created[next], ecs.registry.get_for_write(created[next]));
+		}
+	}
+
+	if (remap_out)
+		*remap_out = std::move(remap);
+
+	return true;
+}
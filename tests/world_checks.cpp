@@ -0,0 +1,229 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <entt/entt.hpp>
+
+#include "ecs.h"
+#include "parse.h"
+
+/*
+	checks what a script cannot see for itself, as a script stops at its first error: each check
+	runs a few statements on a world of its own and then counts what the world was left with.
+	prints a line per check, and fails if any of them does
+*/
+
+// runs `source` on `ctx`, which keeps the statements as it does those of a script; false if it did
+// not parse, or if it failed without `may_fail`
+bool run(Context& ctx, const std::string& source, bool may_fail = false)
+{
+	auto statements = parse(source);
+	if (!ctx.is_parse_okay())
+		return false;
+
+	ctx.interpreted_statements.insert(ctx.interpreted_statements.end(), statements.begin(), statements.end());
+
+	for (auto& statement : statements)
+	{
+		statement->execute(ctx);
+		ecs_dispatch_events(*ctx.ecs);
+		if (ctx.has_errors())
+			break;
+	}
+
+	auto failed = ctx.has_errors();
+	ctx.interpret_error.reset();
+	return may_fail || !failed;
+}
+
+// the number of rows `count n with ...` finds, or -1 if the statement failed
+int count(Context& ctx, const std::string& query)
+{
+	if (!run(ctx, "count n with " + query + ";"))
+		return -1;
+
+	return ctx.scope->get_binding("n")->eval(ctx).data.int_value;
+}
+
+// the values of the collection bound to `name`, or none if it is bound to something else
+Collection collection(Context& ctx, const std::string& name)
+{
+	auto binding = ctx.scope->get_binding(name);
+	if (!binding)
+		return {};
+
+	auto value = binding->eval(ctx);
+	if (value.type != EType::Collection)
+		return {};
+
+	return InternedCollections.interned_collection_values[value.data.intern_collection_index];
+}
+
+bool check(const char* what, bool passed)
+{
+	printf("%-72s %s\n", what, passed ? "ok" : "FAILED");
+	return passed;
+}
+
+// a row failing in one task of a parallel foreach drops the tasks after it, those that ran on
+// other threads meanwhile too: the rows they rewrote in place are put back, so the world is left
+// as the rows in order up to the failing one would leave it, whatever the threads did
+bool check_parallel_failure()
+{
+	bool passed = true;
+	for (std::size_t threads : { 1, 2, 4, 8 })
+	{
+		for (int pass = 0; pass < 20; pass++)
+		{
+			Context ctx;
+			ctx.parallel_workers = threads;
+			passed &= run(ctx,
+				"define Position(x: int, y: int);"
+				"define Velocity(dx: int, dy: int);"
+				"define Faulty();"
+				"define Late();"
+				"create 100 with Position(x: 0, y: 0), Velocity(dx: 1, dy: 0);"
+				"create f with Position(x: 0, y: 0), Velocity(dx: 5, dy: 0), Faulty();"
+				"create 600 with Position(x: 0, y: 0), Velocity(dx: 1, dy: 0), Late();");
+
+			passed &= run(ctx,
+				"parallel foreach e with Position(x, y), Velocity(dx, dy) {"
+				"	attach Position(x: x + dx, y: y) to e;"
+				"	if (dx == 5) { attach Velocity(dx: nowhere, dy: 0) to e; }"
+				"}", true);
+
+			passed &= count(ctx, "Position(x, y) where x == 1") == 100;
+			passed &= count(ctx, "Position(x, y), Faulty where x == 5") == 1;
+			passed &= count(ctx, "Position(x, y), Late where x == 0") == 600;
+		}
+	}
+
+	return check("a failing parallel foreach keeps none of the later tasks", passed);
+}
+
+// the bitmaps of a world of 512 archetypes take nine words, so the AVX2 kernels, where the CPU has
+// them, match every query here at least in part; both they and the word loops must find just the
+// archetypes whose signatures match
+bool check_bitmap_kernels()
+{
+	ECS ecs;
+	std::vector<TypeHandle> tags;
+	for (int k = 0; k < 9; k++)
+	{
+		auto name = "Tag" + std::to_string(k);
+		ecs_create_type(ecs, name, {});
+		tags.push_back(ecs_get_type_handle(ecs, name));
+	}
+
+	for (std::size_t subset = 1; subset < 512; subset++)
+	{
+		auto entity = ecs_create_instance(ecs);
+		for (std::size_t k = 0; k < tags.size(); k++)
+		{
+			if (subset & (std::size_t(1) << k))
+				ecs_adorn_instance(ecs, entity, tags[k]);
+		}
+	}
+
+	bool passed = ecs.archetypes.size() >= 512;
+	for (std::size_t k = 0; k < tags.size(); k++)
+	{
+		auto query = ecs_make_query(ecs, { tags[k], tags[(k + 3) % tags.size()] }, { tags[(k + 5) % tags.size()] });
+
+		std::vector<std::size_t> expected;
+		for (std::size_t a = 0; a < ecs.archetypes.size(); a++)
+		{
+			if (ecs.archetypes[a].signature.matches(query.positive_signature, query.negative_signature))
+				expected.push_back(a);
+		}
+
+		for (bool avx2 : { true, false })
+		{
+			BitmapAvx2 = avx2 && bitmap_cpu_has_avx2();
+			ArchetypeBitmap matched;
+			ecs_match_archetypes(ecs, query, matched);
+			passed &= matched.words.size() >= 4;
+
+			std::vector<std::size_t> found;
+			matched.for_each(0, [&](std::size_t archetype) { found.push_back(archetype); });
+			passed &= found == expected;
+		}
+	}
+
+	BitmapAvx2 = bitmap_cpu_has_avx2();
+	return check(bitmap_cpu_has_avx2()
+		? "the AVX2 bitmap kernels and the word loops match the same archetypes"
+		: "the bitmap word loops match the right archetypes (no AVX2 here)", passed);
+}
+
+// an observer runs on the context that defined it, so it goes with that context, even where the
+// world stays on with another
+bool check_observer_lifetime()
+{
+	std::shared_ptr<ECS> world;
+	bool passed = true;
+	{
+		Context defining;
+		passed &= run(defining,
+			"define Mass(kg: int);"
+			"define Seen();"
+			"on attach Mass(kg) to e { attach Seen() to e; }"
+			"create a with Mass(kg: 1);");
+		passed &= count(defining, "Seen") == 1;
+		world = defining.ecs;
+	}
+
+	Context other(world);
+	passed &= run(other, "create b with Mass(kg: 2);");
+	passed &= count(other, "Seen") == 1;
+	return check("an observer goes with the context that defined it", passed);
+}
+
+// a fork shares its parent's rows and interned collections until it writes to them, and then writes
+// to copies of its own: nothing the fork moves, grows, makes or destroys shows in the parent
+bool check_fork_isolation()
+{
+	Context parent;
+	bool passed = run(parent,
+		"define Position(x: int, y: int);"
+		"define Bag(items: collection);"
+		"create p with Position(x: 1, y: 1), Bag(items: [ 1, 2, 3 ]);"
+		"create 200 with Position(x: 0, y: 0);");
+
+	{
+		auto child = parent.fork();
+		passed &= run(*child,
+			"foreach e with Position(x, y) { attach Position(x: x + 1, y: y) to e; }"
+			"get Bag(items) from p;"
+			"attach Bag(items: items + [ 4 ]) to p;"
+			"create 50 with Position(x: 9, y: 9);"
+			"get Bag(items) from p;");
+		passed &= count(*child, "Position(x, y) where x == 1") == 200;
+		passed &= count(*child, "Position(x, y) where x == 9") == 50;
+		passed &= collection(*child, "items").size() == 4;
+
+		passed &= run(parent, "get Bag(items) from p;");
+		passed &= count(parent, "Position(x, y) where x == 0") == 200;
+		passed &= count(parent, "Position(x, y) where x == 9") == 0;
+		passed &= collection(parent, "items").size() == 3;
+
+		passed &= run(*child, "destroy p;");
+		passed &= count(*child, "Bag(items)") == 0;
+	}
+
+	passed &= count(parent, "Bag(items)") == 1;
+	passed &= count(parent, "Position(x, y) where x == 1") == 1;
+	passed &= run(parent, "get Bag(items) from p;");
+	passed &= collection(parent, "items").size() == 3;
+	return check("writing to a fork leaves its parent's rows and collections alone", passed);
+}
+
+int main(int argc, char* argv[])
+{
+	bool passed = true;
+	passed &= check_parallel_failure();
+	passed &= check_bitmap_kernels();
+	passed &= check_observer_lifetime();
+	passed &= check_fork_isolation();
+	return passed ? 0 : 1;
+}